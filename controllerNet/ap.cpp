@@ -1,5 +1,7 @@
 #include "ap.hpp"
 #include "mac_util.hpp"
+#include "protocol.hpp"
+#include "tlv_schema.hpp"
 #include <arpa/inet.h>
 // #include <fmt/format.h>
 
@@ -72,21 +74,21 @@ std::vector<uint8_t> AP::getAPDataSSIDBroadcast() const {
 std::vector<uint8_t> AP::getAPDataMgntCnt() const {
   std::vector<uint8_t> mgnt_cnt;
   auto c = htonl(mgnt_count_);
-  mgnt_cnt.insert(mgnt_cnt.end(), &c, &c + sizeof(c));
+  mgnt_cnt.insert(mgnt_cnt.end(), reinterpret_cast<uint8_t *>(&c), reinterpret_cast<uint8_t *>(&c) + sizeof(c));
   return mgnt_cnt;
 }
 
 std::vector<uint8_t> AP::getAPDataCtrlCnt() const {
   std::vector<uint8_t> ctrl_cnt;
   auto c = htonl(ctrl_count_);
-  ctrl_cnt.insert(ctrl_cnt.end(), &c, &c + sizeof(c));
+  ctrl_cnt.insert(ctrl_cnt.end(), reinterpret_cast<uint8_t *>(&c), reinterpret_cast<uint8_t *>(&c) + sizeof(c));
   return ctrl_cnt;
 }
 
 std::vector<uint8_t> AP::getAPDataDataCnt() const {
   std::vector<uint8_t> data_cnt;
   auto c = htonl(data_count_);
-  data_cnt.insert(data_cnt.end(), &c, &c + sizeof(c));
+  data_cnt.insert(data_cnt.end(), reinterpret_cast<uint8_t *>(&c), reinterpret_cast<uint8_t *>(&c) + sizeof(c));
   return data_cnt;
 }
 
@@ -106,7 +108,7 @@ std::vector<uint8_t> AP::getAPDataDataRate() const {
 
 std::vector<uint8_t> AP::getAPDataMCS() const {
   std::vector<uint8_t> mcs;
-  mcs.insert(mcs.end(), &mcs_, &mcs_ + sizeof(mcs_));
+  mcs.insert(mcs.end(), reinterpret_cast<const uint8_t *>(&mcs_), reinterpret_cast<const uint8_t *>(&mcs_) + sizeof(mcs_));
   return mcs;
 }
 
@@ -124,7 +126,8 @@ std::vector<uint8_t> AP::getAPDataMimo() const {
 
 std::vector<uint8_t> AP::getAPDataHighestRate() const {
   std::vector<uint8_t> highest_rate;
-  highest_rate.insert(highest_rate.end(), &highest_rate_, &highest_rate_ + sizeof(highest_rate_));
+  highest_rate.insert(highest_rate.end(), reinterpret_cast<const uint8_t *>(&highest_rate_),
+                      reinterpret_cast<const uint8_t *>(&highest_rate_) + sizeof(highest_rate_));
   return highest_rate;
 }
 
@@ -162,4 +165,39 @@ std::vector<uint8_t> AP::getAPDataProbeDT() const {
   std::vector<uint8_t> probe_dt;
   probe_dt.insert(probe_dt.end(), &probe_dt_, &probe_dt_ + sizeof(probe_dt_));
   return probe_dt;
-}
\ No newline at end of file
+}
+
+// wire layout of the APS TLV body, in the order Packet::makeAPData always used
+using APDataSchema = TLVSchema<
+    TLVBandMAC<TLV_TYPE(APData::BSSID), TLV_MEMBER(AP, bssid_), TLV_MEMBER(AP, channel_)>,
+    TLVString<TLV_TYPE(APData::SSID), TLV_MEMBER(AP, ssid_)>,
+    TLVScalar<TLV_TYPE(APData::CHANNEL), TLV_MEMBER(AP, channel_)>,
+    TLVScalar<TLV_TYPE(APData::RSSI), TLV_MEMBER(AP, rssi_)>,
+    TLVScalar<TLV_TYPE(APData::CIPHER), TLV_MEMBER(AP, cipher_)>,
+    TLVScalar<TLV_TYPE(APData::PROTOCOL), TLV_MEMBER(AP, media_)>,
+    TLVScalar<TLV_TYPE(APData::AUTH), TLV_MEMBER(AP, auth_)>,
+    TLVScalar<TLV_TYPE(APData::MODE), TLV_MEMBER(AP, net_type_)>,
+    TLVBytes<TLV_TYPE(APData::SIGNATURE), TLV_MEMBER(AP, signature_), 32>,
+    TLVScalar<TLV_TYPE(APData::SSID_BROADCAST), TLV_MEMBER(AP, ssid_broadcast_)>,
+    TLVScalar<TLV_TYPE(APData::MNGFRM_CNT), TLV_MEMBER(AP, mgnt_count_)>,
+    TLVScalar<TLV_TYPE(APData::CTRLFRM_CNT), TLV_MEMBER(AP, ctrl_count_)>,
+    TLVBandMAC<TLV_TYPE(APData::WDS_AP), TLV_MEMBER(AP, wds_peer_), TLV_MEMBER(AP, channel_)>,
+    TLVBytes<TLV_TYPE(APData::DATA_RATE), TLV_MEMBER(AP, support_rate_), 8>,
+    TLVScalar<TLV_TYPE(APData::MCS), TLV_MEMBER(AP, mcs_), TLVOrder::HOST>,
+    TLVScalar<TLV_TYPE(APData::CHANNEL_WIDTH), TLV_MEMBER(AP, channel_width_)>,
+    TLVScalar<TLV_TYPE(APData::MIMO), TLV_MEMBER(AP, support_mimo_)>,
+    TLVScalar<TLV_TYPE(APData::HIGHEST_RATE), TLV_MEMBER(AP, highest_rate_), TLVOrder::HOST>,
+    TLVScalar<TLV_TYPE(APData::SPATIAL_STREAM), TLV_MEMBER(AP, spatial_stream_)>,
+    TLVScalar<TLV_TYPE(APData::GUARD_INTERVAL), TLV_MEMBER(AP, guard_interval_)>,
+    TLVScalar<TLV_TYPE(APData::WPS), TLV_MEMBER(AP, wps_)>,
+    TLVScalar<TLV_TYPE(APData::PMF), TLV_MEMBER(AP, pmf_)>,
+    TLVScalar<TLV_TYPE(APData::LAST_DT), TLV_MEMBER(AP, last_dt_)>,
+    TLVScalar<TLV_TYPE(APData::PROBE_DT), TLV_MEMBER(AP, probe_dt_)>>;
+
+size_t AP::getAPDataSize() const { return APDataSchema::size(*this); }
+
+uint8_t *AP::writeAPData(uint8_t *out) const { return APDataSchema::encode(*this, out); }
+
+bool AP::readAPData(const uint8_t *data, size_t len) { return APDataSchema::decode(*this, data, len); }
+
+uint64_t AP::getAPDataHash() const { return APDataSchema::hash(*this); }
@@ -67,6 +67,12 @@ public:
   std::vector<uint8_t> getAPDataPMF() const;
   std::vector<uint8_t> getAPDataLastDT() const;
   std::vector<uint8_t> getAPDataProbeDT() const;
+
+  /* APS TLV body, generated from APDataSchema in ap.cpp */
+  size_t getAPDataSize() const;
+  uint8_t *writeAPData(uint8_t *out) const;
+  bool readAPData(const uint8_t *data, size_t len);
+  uint64_t getAPDataHash() const; // changes whenever the encoded TLV body does
 };
 
 #endif /* _WIPS_STRESS_AP_HPP_ */
\ No newline at end of file
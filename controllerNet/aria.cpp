@@ -39,6 +39,7 @@
 /*********************************************************/
 
 #include "aria.hpp"
+#include <string.h>
 
 #define LITTLE_ENDIAN
 
@@ -510,9 +511,146 @@ int DecKeySetup(const Byte *mk, Byte *rk, int keyBits) {
   return rValue;
 }
 
+/* 다중 블록 암호화 엔진.
+ * Crypt()와 같은 라운드 키와 테이블로 독립된 블록 여러 개를 한 번에 처리한다 (ECB, CBC 복호화).
+ * AVX2가 있으면 8블록을 벡터 레인에 하나씩 두고 gather로 S-box 테이블을 조회한다. CPU는 처음 호출할 때 확인.
+ * 그 외에는 블록마다 Crypt(). 블록 간 의존성이 없어 CPU가 이미 여러 블록을 겹쳐 실행하므로,
+ * 스칼라로 블록을 교차시키는 것은 측정상 이득이 없었다.
+ * i와 o는 같은 버퍼여도 된다. */
+static void CryptBlocksRef(const Byte *i, int Nr, const Byte *rk, Byte *o, size_t nblocks) {
+  for (; nblocks > 0; nblocks--, i += 16, o += 16) {
+    Crypt(i, Nr, rk, o);
+  }
+}
+
+#if defined(LITTLE_ENDIAN) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ARIA_AVX2_ENGINE
+
+#define AVX2_SBOX(T, A, B, C, D)                                                                                                           \
+  {                                                                                                                                        \
+    __m256i b3 = _mm256_srli_epi32(T, 24);                                                                                                 \
+    __m256i b2 = _mm256_and_si256(_mm256_srli_epi32(T, 16), ff);                                                                           \
+    __m256i b1 = _mm256_and_si256(_mm256_srli_epi32(T, 8), ff);                                                                            \
+    __m256i b0 = _mm256_and_si256(T, ff);                                                                                                  \
+    T = _mm256_xor_si256(_mm256_xor_si256(_mm256_i32gather_epi32((const int *)A, b3, 4), _mm256_i32gather_epi32((const int *)B, b2, 4)),   \
+                         _mm256_xor_si256(_mm256_i32gather_epi32((const int *)C, b1, 4), _mm256_i32gather_epi32((const int *)D, b0, 4)));  \
+  }
+#define AVX2_MM(T0, T1, T2, T3)                                                                                                            \
+  {                                                                                                                                        \
+    T1 = _mm256_xor_si256(T1, T2);                                                                                                         \
+    T2 = _mm256_xor_si256(T2, T3);                                                                                                         \
+    T0 = _mm256_xor_si256(T0, T1);                                                                                                         \
+    T3 = _mm256_xor_si256(T3, T1);                                                                                                         \
+    T2 = _mm256_xor_si256(T2, T0);                                                                                                         \
+    T1 = _mm256_xor_si256(T1, T2);                                                                                                         \
+  }
+#define AVX2_P(T0, T1, T2, T3)                                                                                                             \
+  {                                                                                                                                        \
+    T1 = _mm256_shuffle_epi8(T1, swap8);                                                                                                   \
+    T2 = _mm256_shuffle_epi8(T2, swap16);                                                                                                  \
+    T3 = _mm256_shuffle_epi8(T3, swap32);                                                                                                  \
+  }
+
+/* 8블록, 레인 j = 블록 j */
+__attribute__((target("avx2"))) static void CryptAVX2x8(const Byte *i, int Nr, const Byte *rk, Byte *o) {
+  const __m256i ff = _mm256_set1_epi32(0xff);
+  const __m256i swap8 = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13,
+                                         12, 15, 14);
+  const __m256i swap16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14,
+                                          15, 12, 13);
+  const __m256i swap32 = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15,
+                                          14, 13, 12);
+  const __m256i stride = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+  const Word *k = reinterpret_cast<const Word *>(rk);
+
+  __m256i t0 = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)(i + 0), stride, 1), swap32);
+  __m256i t1 = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)(i + 4), stride, 1), swap32);
+  __m256i t2 = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)(i + 8), stride, 1), swap32);
+  __m256i t3 = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)(i + 12), stride, 1), swap32);
+
+  for (int r = 0; r < Nr - 1; r++, k += 4) {
+    t0 = _mm256_xor_si256(t0, _mm256_set1_epi32(k[0]));
+    t1 = _mm256_xor_si256(t1, _mm256_set1_epi32(k[1]));
+    t2 = _mm256_xor_si256(t2, _mm256_set1_epi32(k[2]));
+    t3 = _mm256_xor_si256(t3, _mm256_set1_epi32(k[3]));
+    if (r % 2 == 0) {
+      AVX2_SBOX(t0, S1, S2, X1, X2) AVX2_SBOX(t1, S1, S2, X1, X2) AVX2_SBOX(t2, S1, S2, X1, X2) AVX2_SBOX(t3, S1, S2, X1, X2)
+          AVX2_MM(t0, t1, t2, t3) AVX2_P(t0, t1, t2, t3) AVX2_MM(t0, t1, t2, t3)
+    } else {
+      AVX2_SBOX(t0, X1, X2, S1, S2) AVX2_SBOX(t1, X1, X2, S1, S2) AVX2_SBOX(t2, X1, X2, S1, S2) AVX2_SBOX(t3, X1, X2, S1, S2)
+          AVX2_MM(t0, t1, t2, t3) AVX2_P(t2, t3, t0, t1) AVX2_MM(t0, t1, t2, t3)
+    }
+  }
+
+  __m256i t[4] = {t0, t1, t2, t3};
+  Word out[4][8];
+  for (int w = 0; w < 4; w++) {
+    __m256i v = _mm256_xor_si256(t[w], _mm256_set1_epi32(k[w]));
+    __m256i b3 = _mm256_srli_epi32(v, 24);
+    __m256i b2 = _mm256_and_si256(_mm256_srli_epi32(v, 16), ff);
+    __m256i b1 = _mm256_and_si256(_mm256_srli_epi32(v, 8), ff);
+    __m256i b0 = _mm256_and_si256(v, ff);
+    __m256i s3 = _mm256_slli_epi32(_mm256_and_si256(_mm256_i32gather_epi32((const int *)X1, b3, 4), ff), 24);
+    __m256i s2 = _mm256_slli_epi32(_mm256_and_si256(_mm256_i32gather_epi32((const int *)X2, b2, 4), _mm256_set1_epi32(0xff00)), 8);
+    __m256i s1 = _mm256_slli_epi32(_mm256_and_si256(_mm256_i32gather_epi32((const int *)S1, b1, 4), ff), 8);
+    __m256i s0 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)S2, b0, 4), ff);
+    v = _mm256_xor_si256(_mm256_xor_si256(s3, s2), _mm256_xor_si256(s1, s0));
+    v = _mm256_xor_si256(v, _mm256_set1_epi32(k[4 + w]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out[w]), _mm256_shuffle_epi8(v, swap32));
+  }
+  for (int b = 0; b < 8; b++) {
+    for (int w = 0; w < 4; w++) {
+      memcpy(o + 16 * b + 4 * w, &out[w][b], sizeof(Word));
+    }
+  }
+}
+
+static void CryptBlocksAVX2(const Byte *i, int Nr, const Byte *rk, Byte *o, size_t nblocks) {
+  for (; nblocks >= 8; nblocks -= 8, i += 128, o += 128) {
+    CryptAVX2x8(i, Nr, rk, o);
+  }
+  CryptBlocksRef(i, Nr, rk, o, nblocks);
+}
+#endif
+
+typedef void (*CryptBlocksFunc)(const Byte *i, int Nr, const Byte *rk, Byte *o, size_t nblocks);
+
+static CryptBlocksFunc SelectCryptBlocks() {
+#ifdef ARIA_AVX2_ENGINE
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return CryptBlocksAVX2;
+  }
+#endif
+  return CryptBlocksRef;
+}
+
+static CryptBlocksFunc CryptBlocksImpl() {
+  static const CryptBlocksFunc impl = SelectCryptBlocks(); // chosen on first use, safe during static init
+  return impl;
+}
+
+void CryptBlocks(const Byte *i, int Nr, const Byte *rk, Byte *o, size_t nblocks) { CryptBlocksImpl()(i, Nr, rk, o, nblocks); }
+
+const char *CryptBlocksEngine() {
+#ifdef ARIA_AVX2_ENGINE
+  if (CryptBlocksImpl() == CryptBlocksAVX2) {
+    return "avx2";
+  }
+#endif
+  return "reference";
+}
+
+// pads indata in place (up to 16 bytes past indata_len), outdata may be indata
 void EncryptCBC(const Byte *mk, uint32_t keyBits, Byte *indata, uint32_t indata_len, uint8_t *outdata) {
   unsigned char rk[16 * 17] = {0}; // 라운드키
   int rk_len = EncKeySetup(mk, rk, keyBits);
+  EncryptCBCRoundKey(rk, rk_len, indata, indata_len, outdata);
+}
+
+// EncryptCBC() with round keys already expanded by EncKeySetup()
+void EncryptCBCRoundKey(const Byte *rk, int rk_len, Byte *indata, uint32_t indata_len, uint8_t *outdata) {
   int block_unit = 16;
   int block_len = indata_len / block_unit + 1;
   // Insert Padding
@@ -532,23 +670,79 @@ void EncryptCBC(const Byte *mk, uint32_t keyBits, Byte *indata, uint32_t indata_
   }
 }
 
+// EncryptCBCRoundKey() in place over n independent buffers. the chains are serial, so block b of every
+// buffer is encrypted together in one CryptBlocks() call
+void EncryptCBCRoundKeyMany(const Byte *rk, int rk_len, Byte *const *data, const uint32_t *data_len, size_t n) {
+  const int block_unit = 16;
+  const size_t lanes = 8;
+  for (size_t base = 0; base < n; base += lanes) {
+    size_t m = n - base < lanes ? n - base : lanes;
+    Byte stage[block_unit * lanes];
+    size_t lane_of[lanes];
+    uint32_t block_len[lanes];
+    uint32_t max_blocks = 0;
+    for (size_t l = 0; l < m; l++) {
+      Byte *d = data[base + l];
+      uint32_t len = data_len[base + l];
+      block_len[l] = len / block_unit + 1;
+      // Insert Padding
+      for (uint32_t i = len; i < block_len[l] * block_unit; i++) {
+        d[i] = block_unit - (len % block_unit);
+      }
+      if (block_len[l] > max_blocks) {
+        max_blocks = block_len[l];
+      }
+    }
+    for (uint32_t b = 0; b < max_blocks; b++) {
+      size_t k = 0;
+      for (size_t l = 0; l < m; l++) {
+        if (b >= block_len[l]) {
+          continue;
+        }
+        Byte *d = data[base + l];
+        const Byte *chain = b == 0 ? IV : d + (b - 1) * block_unit;
+        for (int j = 0; j < block_unit; j++) {
+          stage[k * block_unit + j] = d[b * block_unit + j] ^ chain[j];
+        }
+        lane_of[k++] = l;
+      }
+      CryptBlocks(stage, rk_len, rk, stage, k);
+      for (size_t q = 0; q < k; q++) {
+        memcpy(data[base + lane_of[q]] + b * block_unit, stage + q * block_unit, block_unit);
+      }
+    }
+  }
+}
+
 void DecryptCBC(const Byte *mk, uint32_t keyBits, Byte *indata, uint32_t indata_len, uint8_t *outdata) {
   unsigned char rk[16 * 17] = {0}; // 라운드키
   int rk_len = DecKeySetup(mk, rk, keyBits);
+  DecryptCBCRoundKey(rk, rk_len, indata, indata_len, outdata);
+}
+
+// DecryptCBC() with round keys already expanded by DecKeySetup()
+void DecryptCBCRoundKey(const Byte *rk, int rk_len, Byte *indata, uint32_t indata_len, uint8_t *outdata) {
   int block_unit = 16;
   int block_len = indata_len / block_unit;
   if ((indata_len % block_unit) > 0) {
     block_len++;
   }
-  Crypt(indata, rk_len, rk, outdata);
-  for (int i = 0; i < block_unit; i++) {
-    outdata[i] = outdata[i] ^ IV[i];
-  }
-  for (int i = 1; i < block_len; i++) {
-    Crypt(indata + (i * block_unit), rk_len, rk, outdata + (i * block_unit));
+  // blocks decrypt independently, so a chunk goes through CryptBlocks() at once.
+  // its ciphertext (and the block before it) is kept aside, so outdata may be indata
+  const int chunk_blocks = 8;
+  Byte prev[16], cur[16 * chunk_blocks];
+  memcpy(prev, IV, block_unit);
+  for (int i = 0; i < block_len; i += chunk_blocks) {
+    int n = block_len - i < chunk_blocks ? block_len - i : chunk_blocks;
+    memcpy(cur, indata + (i * block_unit), n * block_unit);
+    CryptBlocks(cur, rk_len, rk, outdata + (i * block_unit), n);
     for (int j = 0; j < block_unit; j++) {
-      outdata[i * block_unit + j] = outdata[i * block_unit + j] ^ indata[(i - 1) * block_unit + j];
+      outdata[i * block_unit + j] = outdata[i * block_unit + j] ^ prev[j];
+    }
+    for (int j = block_unit; j < n * block_unit; j++) {
+      outdata[i * block_unit + j] = outdata[i * block_unit + j] ^ cur[j - block_unit];
     }
+    memcpy(prev, cur + (n - 1) * block_unit, block_unit);
   }
   // Remove Padding
   int padding_value = outdata[indata_len - 1];
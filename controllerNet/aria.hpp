@@ -1,6 +1,7 @@
 #ifndef _ARIA_HPP_
 #define _ARIA_HPP_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -10,10 +11,15 @@ typedef unsigned int Word;
 void printBlockOfLength(Byte *b, int len);
 void printBlock(Byte *b);
 void Crypt(const Byte *i, int Nr, const Byte *rk, Byte *o);
+void CryptBlocks(const Byte *i, int Nr, const Byte *rk, Byte *o, size_t nblocks); // nblocks independent blocks, i may be o
+const char *CryptBlocksEngine();
 int EncKeySetup(const Byte *mk, Byte *rk, int keyBits);
 int DecKeySetup(const Byte *mk, Byte *rk, int keyBits);
 void EncryptCBC(const Byte *mk, uint32_t keyBits, Byte *indata, uint32_t indata_len, uint8_t *outdata);
 void DecryptCBC(const Byte *mk, uint32_t keyBits, Byte *indata, uint32_t indata_len, uint8_t *outdata);
+void EncryptCBCRoundKey(const Byte *rk, int rk_len, Byte *indata, uint32_t indata_len, uint8_t *outdata);
+void DecryptCBCRoundKey(const Byte *rk, int rk_len, Byte *indata, uint32_t indata_len, uint8_t *outdata);
+void EncryptCBCRoundKeyMany(const Byte *rk, int rk_len, Byte *const *data, const uint32_t *data_len, size_t n);
 void testEncryptAria();
 
 #endif /* _ARIA_HPP_ */
\ No newline at end of file
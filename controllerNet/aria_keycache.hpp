@@ -0,0 +1,134 @@
+#ifndef _ARIA_KEYCACHE_HPP_
+#define _ARIA_KEYCACHE_HPP_
+
+#include "aria.hpp"
+#include "sha1v2.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/// expanded ARIA-128 round keys, as EncKeySetup()/DecKeySetup() leave them
+struct AriaRoundKey {
+  Byte rk[16 * 17];
+  int rounds;
+};
+
+/*
+ * round keys per (shared key, nonce).
+ * the packet key is SHA1(shared key + 2 byte nonce)[0..16], so one shared key only ever yields 65536 keys.
+ * a direct mapped table indexed by the nonce keeps the recently used ones, encrypt and decrypt keys are
+ * filled independently on first use. thread safe, lookups copy the keys out under the lock.
+ */
+class AriaKeyCache {
+public:
+  static constexpr size_t DEFAULT_SLOTS = 64;
+
+private:
+  struct Slot {
+    uint16_t nonce = 0;
+    bool has_enc = false;
+    bool has_dec = false;
+    AriaRoundKey enc;
+    AriaRoundKey dec;
+  };
+
+  std::mutex m_;
+  std::string shared_key_;
+  std::vector<Slot> slots_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+
+protected:
+public:
+  AriaKeyCache(const std::string &shared_key = "", size_t slots = DEFAULT_SLOTS);
+
+  void setSharedKey(const std::string &shared_key);
+
+  AriaRoundKey encKey(uint16_t nonce);
+  AriaRoundKey decKey(uint16_t nonce);
+
+  uint64_t hits();
+  uint64_t misses();
+
+  /// 16 byte ARIA key of one packet, the nonce is taken as it is stored in HEADER::nonce
+  static void deriveKey(const std::string &shared_key, uint16_t nonce, uint8_t key16[16]);
+
+private:
+  Slot &lookup(uint16_t nonce);
+
+protected:
+};
+
+inline AriaKeyCache::AriaKeyCache(const std::string &shared_key, size_t slots) : shared_key_(shared_key), slots_(slots ? slots : 1) {}
+
+inline void AriaKeyCache::setSharedKey(const std::string &shared_key) {
+  std::lock_guard<std::mutex> g(m_);
+  shared_key_ = shared_key;
+  for (auto &slot : slots_) {
+    slot.has_enc = false;
+    slot.has_dec = false;
+  }
+}
+
+inline AriaRoundKey AriaKeyCache::encKey(uint16_t nonce) {
+  std::lock_guard<std::mutex> g(m_);
+  Slot &slot = lookup(nonce);
+  if (slot.has_enc) {
+    hits_++;
+  } else {
+    misses_++;
+    uint8_t key16[16];
+    deriveKey(shared_key_, nonce, key16);
+    slot.enc.rounds = EncKeySetup(key16, slot.enc.rk, 128);
+    slot.has_enc = true;
+  }
+  return slot.enc;
+}
+
+inline AriaRoundKey AriaKeyCache::decKey(uint16_t nonce) {
+  std::lock_guard<std::mutex> g(m_);
+  Slot &slot = lookup(nonce);
+  if (slot.has_dec) {
+    hits_++;
+  } else {
+    misses_++;
+    uint8_t key16[16];
+    deriveKey(shared_key_, nonce, key16);
+    slot.dec.rounds = DecKeySetup(key16, slot.dec.rk, 128);
+    slot.has_dec = true;
+  }
+  return slot.dec;
+}
+
+inline uint64_t AriaKeyCache::hits() {
+  std::lock_guard<std::mutex> g(m_);
+  return hits_;
+}
+
+inline uint64_t AriaKeyCache::misses() {
+  std::lock_guard<std::mutex> g(m_);
+  return misses_;
+}
+
+inline void AriaKeyCache::deriveKey(const std::string &shared_key, uint16_t nonce, uint8_t key16[16]) {
+  uint8_t secret_key[128] = {0};
+  size_t key_len = shared_key.size() < sizeof(secret_key) - 2 ? shared_key.size() : sizeof(secret_key) - 2;
+  memcpy(secret_key, shared_key.data(), key_len);
+  memcpy(secret_key + key_len, &nonce, 2);
+  SHA1Byte16(secret_key, key_len + 2, key16);
+}
+
+// a slot holding another nonce is evicted, both of its directions at once
+inline AriaKeyCache::Slot &AriaKeyCache::lookup(uint16_t nonce) {
+  Slot &slot = slots_[nonce % slots_.size()];
+  if (slot.nonce != nonce) {
+    slot.nonce = nonce;
+    slot.has_enc = false;
+    slot.has_dec = false;
+  }
+  return slot;
+}
+
+#endif /* _ARIA_KEYCACHE_HPP_ */
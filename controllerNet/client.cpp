@@ -1,5 +1,7 @@
 #include "client.hpp"
 #include "mac_util.hpp"
+#include "protocol.hpp"
+#include "tlv_schema.hpp"
 #include <arpa/inet.h>
 // #include <fmt/format.h>
 
@@ -28,7 +30,8 @@ std::vector<uint8_t> Client::getClientDataEAPID() const {
 
 std::vector<uint8_t> Client::getClientDataDataRate() const {
   std::vector<uint8_t> data_rate;
-  data_rate.insert(data_rate.end(), &data_rate_, &data_rate_ + sizeof(data_rate_));
+  data_rate.insert(data_rate.end(), reinterpret_cast<const uint8_t *>(&data_rate_),
+                   reinterpret_cast<const uint8_t *>(&data_rate_) + sizeof(data_rate_));
   return data_rate;
 }
 
@@ -71,28 +74,28 @@ std::vector<uint8_t> Client::getClientDataDataSize() const {
 std::vector<uint8_t> Client::getClientDataMgntCnt() const {
   std::vector<uint8_t> mgnt_cnt;
   auto c = htonl(mgnt_count_);
-  mgnt_cnt.insert(mgnt_cnt.end(), &c, &c + sizeof(c));
+  mgnt_cnt.insert(mgnt_cnt.end(), reinterpret_cast<uint8_t *>(&c), reinterpret_cast<uint8_t *>(&c) + sizeof(c));
   return mgnt_cnt;
 }
 
 std::vector<uint8_t> Client::getClientDataCtrlCnt() const {
   std::vector<uint8_t> ctrl_cnt;
   auto c = htonl(ctrl_count_);
-  ctrl_cnt.insert(ctrl_cnt.end(), &c, &c + sizeof(c));
+  ctrl_cnt.insert(ctrl_cnt.end(), reinterpret_cast<uint8_t *>(&c), reinterpret_cast<uint8_t *>(&c) + sizeof(c));
   return ctrl_cnt;
 }
 
 std::vector<uint8_t> Client::getClientDataDataCnt() const {
   std::vector<uint8_t> data_cnt;
   auto c = htonl(data_count_);
-  data_cnt.insert(data_cnt.end(), &c, &c + sizeof(c));
+  data_cnt.insert(data_cnt.end(), reinterpret_cast<uint8_t *>(&c), reinterpret_cast<uint8_t *>(&c) + sizeof(c));
   return data_cnt;
 }
 
 std::vector<uint8_t> Client::getClientDataAuthCnt() const {
   std::vector<uint8_t> auth_cnt;
   auto c = htonl(auth_count_);
-  auth_cnt.insert(auth_cnt.end(), &c, &c + sizeof(c));
+  auth_cnt.insert(auth_cnt.end(), reinterpret_cast<uint8_t *>(&c), reinterpret_cast<uint8_t *>(&c) + sizeof(c));
   return auth_cnt;
 }
 
@@ -107,3 +110,30 @@ std::vector<uint8_t> Client::getClientDataProbeDT() const {
   probe_dt.insert(probe_dt.end(), &probe_dt_, &probe_dt_ + sizeof(probe_dt_));
   return probe_dt;
 }
+
+// wire layout of the CLIENTS TLV body, in the order Packet::makeClientData always used
+using ClientDataSchema = TLVSchema<
+    TLVBandMAC<TLV_TYPE(ClientData::BSSID), TLV_MEMBER(Client, bssid_), TLV_MEMBER(Client, channel_)>,
+    TLVMAC<TLV_TYPE(ClientData::CLIENT_MAC), TLV_MEMBER(Client, client_mac_)>,
+    TLVBytes<TLV_TYPE(ClientData::EAP_ID), TLV_MEMBER(Client, eap_id_), 32>,
+    TLVScalar<TLV_TYPE(ClientData::DATA_RATE), TLV_MEMBER(Client, data_rate_), TLVOrder::HOST>,
+    TLVScalar<TLV_TYPE(ClientData::SN), TLV_MEMBER(Client, noise_)>,
+    TLVScalar<TLV_TYPE(ClientData::RSSI), TLV_MEMBER(Client, rssi_)>,
+    TLVScalar<TLV_TYPE(ClientData::MIMO), TLV_MEMBER(Client, mimo_)>,
+    TLVBytes<TLV_TYPE(ClientData::SIGNATURE), TLV_MEMBER(Client, signature_), 32>,
+    TLVBytes<TLV_TYPE(ClientData::SIGNATURE_5), TLV_MEMBER(Client, signature5_), 32>,
+    TLVScalar<TLV_TYPE(ClientData::DATA_SIZE), TLV_MEMBER(Client, data_size_)>,
+    TLVScalar<TLV_TYPE(ClientData::MNGFRM_CNT), TLV_MEMBER(Client, mgnt_count_)>,
+    TLVScalar<TLV_TYPE(ClientData::CTRLFRM_CNT), TLV_MEMBER(Client, ctrl_count_)>,
+    TLVScalar<TLV_TYPE(ClientData::DATAFRM_CNT), TLV_MEMBER(Client, data_count_)>,
+    TLVScalar<TLV_TYPE(ClientData::AUTH_COUNT), TLV_MEMBER(Client, auth_count_)>,
+    TLVScalar<TLV_TYPE(ClientData::LAST_DT), TLV_MEMBER(Client, last_dt_)>,
+    TLVScalar<TLV_TYPE(ClientData::PROBE_DT), TLV_MEMBER(Client, probe_dt_)>>;
+
+size_t Client::getClientDataSize() const { return ClientDataSchema::size(*this); }
+
+uint8_t *Client::writeClientData(uint8_t *out) const { return ClientDataSchema::encode(*this, out); }
+
+bool Client::readClientData(const uint8_t *data, size_t len) { return ClientDataSchema::decode(*this, data, len); }
+
+uint64_t Client::getClientDataHash() const { return ClientDataSchema::hash(*this); }
@@ -47,6 +47,12 @@ public:
   std::vector<uint8_t> getClientDataAuthCnt() const;
   std::vector<uint8_t> getClientDataLastDT() const;
   std::vector<uint8_t> getClientDataProbeDT() const;
+
+  /* CLIENTS TLV body, generated from ClientDataSchema in client.cpp */
+  size_t getClientDataSize() const;
+  uint8_t *writeClientData(uint8_t *out) const;
+  bool readClientData(const uint8_t *data, size_t len);
+  uint64_t getClientDataHash() const; // changes whenever the encoded TLV body does
 };
 
 #endif /* _WIPS_STRESS_CLIENT_HPP_ */
\ No newline at end of file
@@ -32,14 +32,8 @@ int main(int argc, char **argv) {
   (*sockmans).push_back(sockman2);
   // ~set sensor vector
 
-  // start threads
   std::shared_ptr<WlanProvider> wp = std::make_shared<WlanProvider>();
-  std::thread t_wp(&WlanProvider::run, wp);
-  t_wp.detach();
   std::shared_ptr<PolCollector> pc = std::make_shared<PolCollector>();
-  std::thread t_pc(&PolCollector::run, pc);
-  t_pc.detach();
-  // ~start threads
 
   // ref wp, pc
   sockman1->setWlanProvider(wp);
@@ -50,14 +44,13 @@ int main(int argc, char **argv) {
 
   // set SEpoll
   auto lamb_setFunc = [](SocketManager &sockman, int sock) -> void {
-    if (sock == -1) {
-      sockman.setState(ConnectionState::INIT);
-    } else if (sockman.getSock() == -1 && sock > 0) {
+    bool connected = sockman.getSock() == -1 && sock > 0;
+    sockman.setSock(sock); // back to INIT, also on -1
+    if (connected) {
       sockman.setState(ConnectionState::VERIFY_MAC);
     }
-    sockman.setSock(sock);
   };
-  auto lamb_getFunc = [](SocketManager sockman) -> int { //
+  auto lamb_getFunc = [](SocketManager &sockman) -> int { //
     return sockman.getSock();
   };
   std::shared_ptr<SEpoll<SocketManager>> mysepoll =
@@ -67,34 +60,59 @@ int main(int argc, char **argv) {
   mysepoll->setInitWriteFunc([](int fd, short what, void *arg) -> void { static_cast<SocketManager *>(arg)->loginWriteFunc(fd, what); },
                              EPOLLOUT | EPOLLONESHOT); //***원샷 구현***
 
+  sockman1->setSEpollRef(mysepoll);
+  sockman2->setSEpollRef(mysepoll);
   wp->setSEpollRef(mysepoll);
   wp->setTotalSockMansRef(sockmans);
   pc->setSEpollRef(mysepoll);
   pc->setTotalSockMansRef(sockmans);
 
-  std::thread t_sepoll(&SEpoll<SocketManager>::run, mysepoll);
-  t_sepoll.detach();
+  mysepoll->setHandshakeTimeout(30000);
   // ~set SEpoll
 
-  // wait all obj set
-  while (true) {
-    for (auto it = sockmans->begin(); it != sockmans->end(); /**/) {
-      if (static_cast<int>((*it)->getMode()) == static_cast<int>(ConnectionMode::DATA)) {
-        mysepoll->unsetReadFunc((*it)->getSock());
-        wp->setSockMan(*it);
-        it = sockmans->erase(it);
-      } else if (static_cast<int>((*it)->getMode()) == static_cast<int>(ConnectionMode::CONFIG)) {
-        mysepoll->unsetReadFunc((*it)->getSock());
-        pc->setSockMan(*it);
-        it = sockmans->erase(it);
-      } else {
-        it++;
-      }
-    }
+  // start jobs
+  wp->start();
+
+  // hand logged-in sockets over to their owner
+  SEpoll<SocketManager> *sepoll = mysepoll.get();
+  std::vector<std::shared_ptr<SocketManager>> all_sockmans = *sockmans;
+  uint32_t loop_cnt = 0;
+  mysepoll->addTimer(
+      1000,
+      [sepoll, sockmans, all_sockmans, wp, pc, loop_cnt]() mutable -> void {
+        // closed after their handoff, they log in again before going back to their owner
+        for (auto &sockman : wp->takeReleasedSockMans()) {
+          sockmans->push_back(sockman);
+        }
+        for (auto &sockman : pc->takeReleasedSockMans()) {
+          sockmans->push_back(sockman);
+        }
+        for (auto it = sockmans->begin(); it != sockmans->end(); /**/) {
+          if (static_cast<int>((*it)->getMode()) == static_cast<int>(ConnectionMode::DATA)) {
+            sepoll->unsetReadFunc((*it)->getSock());
+            wp->setSockMan(*it);
+            it = sockmans->erase(it);
+          } else if (static_cast<int>((*it)->getMode()) == static_cast<int>(ConnectionMode::CONFIG)) {
+            sepoll->unsetReadFunc((*it)->getSock());
+            pc->setSockMan(*it);
+            it = sockmans->erase(it);
+          } else {
+            it++;
+          }
+        }
+
+        if (++loop_cnt % 60 == 0) {
+          sepoll->getDispatchLatency().print("SEpoll dispatch");
+          for (auto &sockman : all_sockmans) {
+            sockman->printSendStats();
+            sockman->printRecvStats();
+          }
+        }
+      },
+      1000);
+  // ~start jobs
 
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-  }
-  // ~wait all obj set
+  mysepoll->run(); // main thread becomes the reactor
 #endif
 
   return 0;
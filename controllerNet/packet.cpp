@@ -5,52 +5,135 @@
 #include "protocol.hpp"
 #include "sha1v2.hpp"
 #include "sha256.hpp"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <fmt/format.h>
 #include <string.h>
 
-Packet::Packet(){};
+constexpr size_t PacketBufferPool::MAX_POOLED;
+constexpr size_t Packet::HEADROOM;
+constexpr size_t Packet::TAILROOM;
+constexpr size_t Packet::MAX_BODY;
+constexpr size_t Packet::BUFFER_SIZE;
+static_assert(Packet::TAILROOM >= SHA256::DIGEST_SIZE + 16, "encrypt() pads into the tail room");
 
-Packet::~Packet(){};
+std::vector<std::vector<uint8_t>> &PacketBufferPool::local() {
+  thread_local std::vector<std::vector<uint8_t>> pool;
+  return pool;
+}
+
+// empty buffer with at least BUFFER_SIZE capacity, allocates only while the pool is warming up
+std::vector<uint8_t> PacketBufferPool::acquire() {
+  auto &pool = local();
+  if (pool.empty()) {
+    std::vector<uint8_t> buf;
+    buf.reserve(Packet::BUFFER_SIZE);
+    return buf;
+  }
+  std::vector<uint8_t> buf = std::move(pool.back());
+  pool.pop_back();
+  buf.clear();
+  return buf;
+}
+
+void PacketBufferPool::release(std::vector<uint8_t> &&buf) {
+  auto &pool = local();
+  if (buf.capacity() < Packet::BUFFER_SIZE || pool.size() >= MAX_POOLED) {
+    return; // moved-from or oversized leftovers are simply freed
+  }
+  if (pool.capacity() < MAX_POOLED) {
+    pool.reserve(MAX_POOLED);
+  }
+  pool.push_back(std::move(buf));
+}
+
+Packet::Packet() : _data(PacketBufferPool::acquire()) {
+  _data.resize(HEADROOM);
+  _head = HEADROOM;
+};
+
+Packet::Packet(const Packet &other) : _data(PacketBufferPool::acquire()), _head(other._head) { //
+  _data.insert(_data.end(), other._data.begin(), other._data.end());
+}
+
+Packet::Packet(Packet &&other) noexcept : _data(std::move(other._data)), _head(other._head) { other._head = 0; }
+
+Packet &Packet::operator=(const Packet &other) {
+  if (this != &other) {
+    _data.assign(other._data.begin(), other._data.end());
+    _head = other._head;
+  }
+  return *this;
+}
+
+Packet &Packet::operator=(Packet &&other) noexcept {
+  if (this != &other) {
+    PacketBufferPool::release(std::move(_data));
+    _data = std::move(other._data);
+    _head = other._head;
+    other._head = 0;
+  }
+  return *this;
+}
+
+Packet::~Packet() { PacketBufferPool::release(std::move(_data)); };
+
+void Packet::insert(const uint8_t *buf, size_t len) { _data.insert(_data.end(), buf, buf + len); }
+
+size_t Packet::size() { return _data.size() - _head; }
+
+uint8_t *Packet::data() { return _data.data() + _head; }
+
+PacketView Packet::view() { return PacketView(data(), size()); }
+
+// headers are written backwards into the headroom, so the payload never moves
+void Packet::prepend(const uint8_t *buf, size_t len) {
+  if (_head >= len) {
+    _head -= len;
+    memcpy(&_data[_head], buf, len);
+  } else {
+    _data.insert(_data.begin() + _head, buf, buf + len);
+  }
+}
 
-void Packet::insert(uint8_t *buf, size_t len) { _data.insert(_data.end(), buf, buf + len); }
+PacketView::PacketView(const uint8_t *data, size_t len) : _ptr(data), _len(len) {}
 
-size_t Packet::size() { return _data.size(); }
+size_t PacketView::size() const { return _len; }
 
-uint8_t *Packet::data() { return _data.data(); }
+const uint8_t *PacketView::data() const { return _ptr; }
 
-uint16_t Packet::getSeq() {
-  HEADER *h = reinterpret_cast<HEADER *>(&_data[0]);
+uint16_t PacketView::getSeq() const {
+  const HEADER *h = reinterpret_cast<const HEADER *>(&data()[0]);
   uint16_t seq;
   memcpy(&seq, &(*h).seq, sizeof(seq));
   seq = ntohs(seq);
   return seq;
 }
 
-uint16_t Packet::getHeaderLength() {
-  HEADER *h = reinterpret_cast<HEADER *>(&_data[0]);
+uint16_t PacketView::getHeaderLength() const {
+  const HEADER *h = reinterpret_cast<const HEADER *>(&data()[0]);
   uint16_t length = ntohs((*h).length);
   return length;
 }
 
-Messages Packet::getBodyHeaderType() {
-  BODYHEADER *b = reinterpret_cast<BODYHEADER *>(&_data[sizeof(HEADER)]);
+Messages PacketView::getBodyHeaderType() const {
+  const BODYHEADER *b = reinterpret_cast<const BODYHEADER *>(&data()[sizeof(HEADER)]);
   return (*b).type;
 }
 
-uint16_t Packet::getBodyHeaderLength() {
-  BODYHEADER *b = reinterpret_cast<BODYHEADER *>(&_data[sizeof(HEADER)]);
+uint16_t PacketView::getBodyHeaderLength() const {
+  const BODYHEADER *b = reinterpret_cast<const BODYHEADER *>(&data()[sizeof(HEADER)]);
   return ntohs((*b).length);
 }
 
-uint8_t Packet::getBodyType() { //
-  return _data[sizeof(HEADER) + sizeof(BODYHEADER)];
+uint8_t PacketView::getBodyType() const { //
+  return data()[sizeof(HEADER) + sizeof(BODYHEADER)];
 }
 
-std::vector<uint8_t> Packet::getAuthCode() {
+std::vector<uint8_t> PacketView::getAuthCode() const {
   std::vector<uint8_t> auth_code;
   int32_t body_pos = sizeof(HEADER) + sizeof(BODYHEADER);
-  TLV *body = reinterpret_cast<TLV *>(&_data[body_pos]);
+  const TLV *body = reinterpret_cast<const TLV *>(&data()[body_pos]);
   uint16_t length = 0;
 
   if (static_cast<LoginRequest>((*body).type) != LoginRequest::CHALLENGE) {
@@ -58,11 +141,11 @@ std::vector<uint8_t> Packet::getAuthCode() {
     return auth_code;
   }
   while (true) {
-    LOGIN_REQUEST_TLV *tlv = reinterpret_cast<LOGIN_REQUEST_TLV *>(&_data[body_pos + sizeof(*body) + length]);
+    const LOGIN_REQUEST_TLV *tlv = reinterpret_cast<const LOGIN_REQUEST_TLV *>(&data()[body_pos + sizeof(*body) + length]);
 
     if ((*tlv).type == LoginValue::AUTH) {
       int data_pos = body_pos + sizeof(*body) + length + 3;
-      auth_code.insert(auth_code.end(), &_data[data_pos], &_data[data_pos + ntohs((*tlv).length)]);
+      auth_code.insert(auth_code.end(), &data()[data_pos], &data()[data_pos + ntohs((*tlv).length)]);
       return auth_code;
     }
 
@@ -74,10 +157,10 @@ std::vector<uint8_t> Packet::getAuthCode() {
   return auth_code;
 }
 
-tl::optional<uint32_t> Packet::getNonce() {
-  uint32_t *nonce;
+tl::optional<uint32_t> PacketView::getNonce() const {
+  const uint32_t *nonce;
   int32_t body_pos = sizeof(HEADER) + sizeof(BODYHEADER);
-  TLV *body = reinterpret_cast<TLV *>(&_data[body_pos]);
+  const TLV *body = reinterpret_cast<const TLV *>(&data()[body_pos]);
   uint16_t length = 0;
 
   if (static_cast<LoginRequest>((*body).type) != LoginRequest::START) {
@@ -85,11 +168,11 @@ tl::optional<uint32_t> Packet::getNonce() {
     return tl::nullopt;
   }
   while (true) {
-    TLV *tlv = reinterpret_cast<TLV *>(&_data[body_pos + sizeof(*body) + length]);
+    const TLV *tlv = reinterpret_cast<const TLV *>(&data()[body_pos + sizeof(*body) + length]);
 
     if (static_cast<LoginValue>((*tlv).type) == LoginValue::NONCE) {
       int data_pos = body_pos + sizeof(*body) + length + 3;
-      nonce = reinterpret_cast<uint32_t *>(&_data[data_pos]);
+      nonce = reinterpret_cast<const uint32_t *>(&data()[data_pos]);
       auto n = ntohl(*nonce);
       return tl::make_optional<uint32_t>(n);
     }
@@ -102,10 +185,10 @@ tl::optional<uint32_t> Packet::getNonce() {
   return tl::nullopt;
 }
 
-tl::optional<uint32_t> Packet::getSensorID() {
-  uint32_t *sensor_id;
+tl::optional<uint32_t> PacketView::getSensorID() const {
+  const uint32_t *sensor_id;
   int32_t body_pos = sizeof(HEADER) + sizeof(BODYHEADER);
-  TLV *body = reinterpret_cast<TLV *>(&_data[body_pos]);
+  const TLV *body = reinterpret_cast<const TLV *>(&data()[body_pos]);
   uint16_t length = 0;
 
   if (static_cast<SetConfig>((*body).type) != SetConfig::SENSOR_ID) {
@@ -113,11 +196,11 @@ tl::optional<uint32_t> Packet::getSensorID() {
     return tl::nullopt;
   }
   while (true) {
-    TLV *tlv = reinterpret_cast<TLV *>(&_data[body_pos + sizeof(*body) + length]);
+    const TLV *tlv = reinterpret_cast<const TLV *>(&data()[body_pos + sizeof(*body) + length]);
 
     if (static_cast<SetSensorIDValue>((*tlv).type) == SetSensorIDValue::SENSOR_ID) {
       int data_pos = body_pos + sizeof(*body) + length + 3;
-      sensor_id = reinterpret_cast<uint32_t *>(&_data[data_pos]);
+      sensor_id = reinterpret_cast<const uint32_t *>(&data()[data_pos]);
       auto s = ntohl(*sensor_id);
       return tl::make_optional<uint32_t>(s);
     }
@@ -130,7 +213,7 @@ tl::optional<uint32_t> Packet::getSensorID() {
   return tl::nullopt;
 }
 
-tl::optional<ConnectionMode> Packet::getMode() {
+tl::optional<ConnectionMode> PacketView::getMode() const {
   if (getBodyHeaderType() == Messages::C2S_DATA_REQUEST)
     return tl::make_optional(ConnectionMode::DATA);
   if (getBodyHeaderType() == Messages::C2S_SET_CONFIG)
@@ -139,42 +222,94 @@ tl::optional<ConnectionMode> Packet::getMode() {
 }
 
 void Packet::encrypt(const std::string &shared_key) {
-  std::vector<uint8_t> enc_packet; // 암호화가 완료된 패킷
-  uint8_t data[8196] = {0};        // 암호화할 데이터
-  uint8_t enc_data[8196] = {0};    // 암호화된 데이터
-  int32_t enc_data_len = getHeaderLength();
+  AriaKeyCache keys(shared_key, 1);
+  encrypt(keys);
+}
+
+// encrypts in place: the digest and CBC padding go into the tail room, the header is rewritten where it is
+void Packet::encrypt(AriaKeyCache &keys) {
+  uint32_t plain_len = 0;
+  if (!growForEncrypt(plain_len)) {
+    return;
+  }
+  uint8_t *body = data() + sizeof(HEADER);
+
   srand(time(nullptr));
   uint16_t nonce = (uint16_t)rand();
 
-  uint8_t secret_key[128] = {0}; // 암호화 key
-  int32_t secret_key_len = 0;
-
-  SHA256 sha256;
-  uint8_t digest[SHA256::DIGEST_SIZE] = {0};
+  /* 데이터 무결성 값을 패킷의 맨 뒤에 붙여준다. */
+  SHA256::digest(body, plain_len, body + plain_len);
 
-  memcpy(data, _data.data() + sizeof(HEADER), enc_data_len);
+  /* 암호화 키 = sha1(사전 공유 키 + Nonce (2 bytes)) 16Byte, 라운드키는 캐시에서 */
+  AriaRoundKey rk = keys.encKey(nonce);
+  EncryptCBCRoundKey(rk.rk, rk.rounds, body, plain_len + SHA256::DIGEST_SIZE, body);
 
-  /* 데이터 무결성 값을 패킷의 맨 뒤에 붙여준다. */
-  sha256.sha256_bin(data, enc_data_len, digest);
-  memcpy(data + enc_data_len, digest, SHA256::DIGEST_SIZE);
-  enc_data_len += SHA256::DIGEST_SIZE;
+  writeEncryptedHeader(nonce);
+}
 
-  /* 암호화에 사용될 키 생성 = 사전 공유 키 + Nonce (2 bytes) */
-  memcpy(secret_key, shared_key.data(), shared_key.size());
-  memcpy(secret_key + shared_key.size(), &nonce, 2);
-  secret_key_len = shared_key.size() + 2;
+// encrypt() for a burst of finished packets: one nonce and key, digests and CBC chains run side by side.
+// packets too large to encrypt are removed from the batch, the rest keep their order
+void Packet::encryptBatch(std::vector<Packet> &packets, AriaKeyCache &keys) {
+  const size_t lanes = 8;
+  bool dropped = false;
+  srand(time(nullptr));
+  uint16_t nonce = (uint16_t)rand();
+  AriaRoundKey rk = keys.encKey(nonce);
+
+  for (size_t base = 0; base < packets.size(); base += lanes) {
+    Packet *lane[lanes];
+    uint8_t *body[lanes];
+    size_t plain_len[lanes];
+    uint32_t cbc_len[lanes];
+    uint8_t digest[lanes][SHA256::DIGEST_SIZE];
+    size_t n = 0;
+    for (size_t i = base; i < packets.size() && i < base + lanes; i++) {
+      uint32_t len = 0;
+      if (!packets[i].growForEncrypt(len)) {
+        dropped = true;
+        continue;
+      }
+      lane[n] = &packets[i];
+      body[n] = packets[i].data() + sizeof(HEADER);
+      plain_len[n] = len;
+      cbc_len[n] = len + SHA256::DIGEST_SIZE;
+      n++;
+    }
 
-  /* 암호화 */
-  // encrypt_ARIA128_CBC_PKI(secret_key_len, secret_key, enc_data_len, data, enc_data);
-  // 암호화키 sha1 변환, 16Byte만 컷
-  uint8_t sha1key16[16] = {0};
-  SHA1Byte16(secret_key, secret_key_len, sha1key16);
-  EncryptCBC(sha1key16, 128, data, enc_data_len, enc_data);
+    SHA256::digestMany(body, plain_len, n, digest);
+    for (size_t l = 0; l < n; l++) {
+      memcpy(body[l] + plain_len[l], digest[l], SHA256::DIGEST_SIZE);
+    }
+    EncryptCBCRoundKeyMany(rk.rk, rk.rounds, body, cbc_len, n);
+    for (size_t l = 0; l < n; l++) {
+      lane[l]->writeEncryptedHeader(nonce);
+    }
+  }
+  if (dropped) {
+    packets.erase(std::remove_if(packets.begin(), packets.end(), [](Packet &p) { return p.size() == 0; }), packets.end());
+  }
+}
 
-  enc_data_len = enc_data_len + (16 - (enc_data_len % 16)); // add padding
+// sizes the buffer for digest and padding, false (and an emptied packet) when it would not fit the length field.
+// measured from the buffer, the header's 16 bit length has already wrapped for a body past UINT16_MAX
+bool Packet::growForEncrypt(uint32_t &plain_len) {
+  plain_len = size() - sizeof(HEADER);
+  size_t enc_data_len = cipherLength(plain_len);
+  if (enc_data_len > UINT16_MAX) {
+    fmt::print("Encrypt Failed - packet too large ({})\n", plain_len);
+    _data.resize(_head); // nothing is sent rather than a truncated frame
+    return false;
+  }
+  _data.resize(_head + sizeof(HEADER) + enc_data_len);
+  return true;
+}
 
-  enc_packet.insert(enc_packet.begin(), enc_data, enc_data + enc_data_len);
+size_t Packet::cipherLength(size_t plain_len) {
+  size_t enc_data_len = plain_len + SHA256::DIGEST_SIZE;
+  return enc_data_len + (16 - (enc_data_len % 16)); // add padding
+}
 
+void Packet::writeEncryptedHeader(uint16_t nonce) {
   FLAGS flags;
   flags.cipher = 1;
   flags.fragment = 0;
@@ -182,48 +317,41 @@ void Packet::encrypt(const std::string &shared_key) {
 
   HEADER h;
   h.version = 0;
-  h.seq = htons(getSeq());
+  h.seq = htons(view().getSeq());
   h.flags = flags;
   h.offset = 0;
+  h.option = 0;
   h.nonce = nonce;
   h.subtype = Protocol::SWMP;
   h.res = 0;
-  h.length = htons(enc_data_len);
-
-  enc_packet.insert(enc_packet.begin(), reinterpret_cast<uint8_t *>(&h), reinterpret_cast<uint8_t *>(&h) + sizeof(h));
+  h.length = htons(size() - sizeof(HEADER));
 
-  _data.swap(enc_packet);
+  memcpy(data(), &h, sizeof(h));
 }
 
-tl::optional<Packet> Packet::decrypt(const std::string &shared_key) {
-  // Packet enc_packet;
-  uint8_t data[8196] = {0}; // 암호화할 데이터
-  uint8_t dec_data[8196] = {0};
-  uint32_t dec_len = _data.size() - sizeof(HEADER);
-
-  memcpy(data, _data.data() + sizeof(HEADER), _data.size() - sizeof(HEADER));
+// the frame is only read: it is copied once into a pooled packet and decrypted there in place
+tl::optional<Packet> Packet::decrypt(const PacketView &frame, const std::string &shared_key) {
+  AriaKeyCache keys(shared_key, 1);
+  return decrypt(frame, keys);
+}
 
-  HEADER *h = reinterpret_cast<HEADER *>(_data.data());
+tl::optional<Packet> Packet::decrypt(const PacketView &frame, AriaKeyCache &keys) {
+  if (frame.size() < sizeof(HEADER) + 16 || (frame.size() - sizeof(HEADER)) % 16) {
+    fmt::print("Decrypt Failed - bad frame length ({})\n", frame.size());
+    return tl::nullopt;
+  }
 
-  /** make secret_key */
-  uint8_t secret_key[128] = {0};
-  int32_t secret_key_len = 0;
-  memcpy(secret_key, shared_key.data(), shared_key.size());
-  memcpy(secret_key + shared_key.size(), &h->nonce, 2);
-  secret_key_len = shared_key.size() + 2;
+  Packet decrypt_packet;
+  decrypt_packet.insert(frame.data(), frame.size());
+  HEADER *h = reinterpret_cast<HEADER *>(decrypt_packet.data());
+  uint8_t *dec_data = decrypt_packet.data() + sizeof(HEADER);
+  uint32_t dec_len = frame.size() - sizeof(HEADER);
 
   /** decrypt */
-  uint8_t sha1key16[16] = {0};
-  SHA1Byte16(secret_key, secret_key_len, sha1key16);
-#if 0
-  fmt::print("secret_key : {}\n", secret_key);
-  fmt::print("sha1key16 : ");
-  for (int i = 0; i < 16; i++) {
-    fmt::print("{:02x}", sha1key16[i]);
-  }
-  fmt::print("\n");
-#endif
-  DecryptCBC(sha1key16, 128, data, dec_len, dec_data);
+  uint16_t nonce;
+  memcpy(&nonce, &h->nonce, sizeof(nonce));
+  AriaRoundKey rk = keys.decKey(nonce);
+  DecryptCBCRoundKey(rk.rk, rk.rounds, dec_data, dec_len, dec_data);
 #if 0
   fmt::print("dec_data\n");
   for (int i = 0; i < dec_len; i++) {
@@ -234,14 +362,17 @@ tl::optional<Packet> Packet::decrypt(const std::string &shared_key) {
 
   BODYHEADER b;
   memcpy(&b, dec_data, sizeof(b));
+  uint16_t header_length = ntohs(b.length) + sizeof(BODYHEADER);
+  if (header_length + SHA256::DIGEST_SIZE > dec_len) {
+    fmt::print("Decrypt Failed - body length {} exceeds frame ({})\n", header_length, dec_len);
+    return tl::nullopt;
+  }
 
   /** verify hash */
-  uint8_t recv_hash[SHA256::DIGEST_SIZE] = {0};
-  memcpy(recv_hash, dec_data + sizeof(BODYHEADER) + ntohs(b.length), SHA256::DIGEST_SIZE);
+  const uint8_t *recv_hash = dec_data + header_length;
 
   uint8_t make_hash[SHA256::DIGEST_SIZE] = {0};
-  SHA256 sha256;
-  sha256.sha256_bin(dec_data, ntohs(b.length) + sizeof(BODYHEADER), make_hash);
+  SHA256::digest(dec_data, header_length, make_hash);
 
   if (memcmp(recv_hash, make_hash, SHA256::DIGEST_SIZE)) {
     fmt::print("Decrypt Failed - Hash verification failed.\n");
@@ -258,14 +389,10 @@ tl::optional<Packet> Packet::decrypt(const std::string &shared_key) {
     return tl::nullopt;
   }
 
-  uint16_t header_length = ntohs(b.length) + sizeof(BODYHEADER);
   h->length = htons(header_length);
+  decrypt_packet._data.resize(decrypt_packet._head + sizeof(HEADER) + header_length); // drop digest and padding
 
-  Packet decrypt_packet;
-  decrypt_packet.insert(_data.data(), sizeof(HEADER));
-  decrypt_packet.insert(dec_data, ntohs(b.length) + sizeof(BODYHEADER));
-
-  return tl::make_optional(decrypt_packet);
+  return tl::make_optional(std::move(decrypt_packet));
 }
 
 void Packet::makeSensorID(const uint32_t &sensor_id) {
@@ -337,141 +464,31 @@ void Packet::makeHashData(SetConfigList setcfg, std::vector<uint8_t> v) { //
 }
 
 void Packet::makeAPData(const AP &ap) {
-  Packet p;
-
-  std::vector<uint8_t> band_bssid = ap.getAPDataBSSID();
-  p.makeAPDataTLV(APData::BSSID, band_bssid.size(), band_bssid.data());
-
-  std::vector<uint8_t> ssid = ap.getAPDataSSID();
-  p.makeAPDataTLV(APData::SSID, ssid.size(), ssid.data());
-
-  std::vector<uint8_t> channel = ap.getAPDataChannel();
-  p.makeAPDataTLV(APData::CHANNEL, channel.size(), channel.data());
-
-  std::vector<uint8_t> rssi = ap.getAPDataRSSI();
-  p.makeAPDataTLV(APData::RSSI, rssi.size(), rssi.data());
-
-  std::vector<uint8_t> cipher = ap.getAPDataCipher();
-  p.makeAPDataTLV(APData::CIPHER, cipher.size(), cipher.data());
-
-  std::vector<uint8_t> protocol = ap.getAPDataProtocol();
-  p.makeAPDataTLV(APData::PROTOCOL, protocol.size(), protocol.data());
-
-  std::vector<uint8_t> auth = ap.getAPDataAuth();
-  p.makeAPDataTLV(APData::AUTH, auth.size(), auth.data());
-
-  std::vector<uint8_t> mode = ap.getAPDataMode();
-  p.makeAPDataTLV(APData::MODE, mode.size(), mode.data());
-
-  std::vector<uint8_t> signature = ap.getAPDataSignature();
-  p.makeAPDataTLV(APData::SIGNATURE, signature.size(), signature.data());
-
-  std::vector<uint8_t> ssid_b = ap.getAPDataSSIDBroadcast();
-  p.makeAPDataTLV(APData::SSID_BROADCAST, ssid_b.size(), ssid_b.data());
-
-  std::vector<uint8_t> m_cnt = ap.getAPDataMgntCnt();
-  p.makeAPDataTLV(APData::MNGFRM_CNT, m_cnt.size(), m_cnt.data());
-
-  std::vector<uint8_t> c_cnt = ap.getAPDataCtrlCnt();
-  p.makeAPDataTLV(APData::CTRLFRM_CNT, c_cnt.size(), c_cnt.data());
-
-  std::vector<uint8_t> wds_peer = ap.getAPDataWDSPeer();
-  p.makeAPDataTLV(APData::WDS_AP, wds_peer.size(), wds_peer.data());
-
-  std::vector<uint8_t> data_rate = ap.getAPDataDataRate();
-  p.makeAPDataTLV(APData::DATA_RATE, data_rate.size(), data_rate.data());
-
-  std::vector<uint8_t> mcs = ap.getAPDataMCS();
-  p.makeAPDataTLV(APData::MCS, mcs.size(), mcs.data());
-
-  std::vector<uint8_t> channel_width = ap.getAPDataChannelWidth();
-  p.makeAPDataTLV(APData::CHANNEL_WIDTH, channel_width.size(), channel_width.data());
-
-  std::vector<uint8_t> mimo = ap.getAPDataMimo();
-  p.makeAPDataTLV(APData::MIMO, mimo.size(), mimo.data());
-
-  std::vector<uint8_t> highest_rate = ap.getAPDataHighestRate();
-  p.makeAPDataTLV(APData::HIGHEST_RATE, highest_rate.size(), highest_rate.data());
+  size_t pos = _data.size();
+  _data.resize(pos + sizeof(TLV) + ap.getAPDataSize());
 
-  std::vector<uint8_t> ss = ap.getAPDataSpatialStream();
-  p.makeAPDataTLV(APData::SPATIAL_STREAM, ss.size(), ss.data());
+  uint8_t *body = &_data[pos + sizeof(TLV)];
+  uint16_t length = ap.writeAPData(body) - body;
 
-  std::vector<uint8_t> gi = ap.getAPDataGuardInterval();
-  p.makeAPDataTLV(APData::GUARD_INTERVAL, gi.size(), gi.data());
-
-  std::vector<uint8_t> wps = ap.getAPDataWPS();
-  p.makeAPDataTLV(APData::WPS, wps.size(), wps.data());
-
-  std::vector<uint8_t> pmf = ap.getAPDataPMF();
-  p.makeAPDataTLV(APData::PMF, pmf.size(), pmf.data());
-
-  std::vector<uint8_t> last_dt = ap.getAPDataLastDT();
-  p.makeAPDataTLV(APData::LAST_DT, last_dt.size(), last_dt.data());
-
-  std::vector<uint8_t> probe_dt = ap.getAPDataProbeDT();
-  p.makeAPDataTLV(APData::PROBE_DT, probe_dt.size(), probe_dt.data());
-
-  uint16_t length = htons((uint16_t)p._data.size());
-  _data.insert(_data.end(), static_cast<uint8_t>(DataValue::APS));
-  _data.insert(_data.end(), reinterpret_cast<uint8_t *>(&length), reinterpret_cast<uint8_t *>(&length) + sizeof(length));
-  _data.insert(_data.end(), p._data.begin(), p._data.end());
+  TLV tlv;
+  tlv.type = static_cast<uint8_t>(DataValue::APS);
+  tlv.length = htons(length);
+  memcpy(&_data[pos], &tlv, sizeof(tlv));
+  _data.resize(pos + sizeof(TLV) + length);
 }
 
 void Packet::makeClientData(const Client &client) {
-  Packet p;
-
-  std::vector<uint8_t> band_bssid = client.getClientDataBSSID();
-  p.makeClientDataTLV(ClientData::BSSID, band_bssid.size(), band_bssid.data());
-
-  std::vector<uint8_t> client_mac = client.getClientDataClientMAC();
-  p.makeClientDataTLV(ClientData::CLIENT_MAC, client_mac.size(), client_mac.data());
-
-  std::vector<uint8_t> eap_id = client.getClientDataEAPID();
-  p.makeClientDataTLV(ClientData::EAP_ID, eap_id.size(), eap_id.data());
-
-  std::vector<uint8_t> data_rate = client.getClientDataDataRate();
-  p.makeClientDataTLV(ClientData::DATA_RATE, data_rate.size(), data_rate.data());
-
-  std::vector<uint8_t> noise = client.getClientDataNoise();
-  p.makeClientDataTLV(ClientData::SN, noise.size(), noise.data());
-
-  std::vector<uint8_t> rssi = client.getClientDataRSSI();
-  p.makeClientDataTLV(ClientData::RSSI, rssi.size(), rssi.data());
-
-  std::vector<uint8_t> mimo = client.getClientDataMimo();
-  p.makeClientDataTLV(ClientData::MIMO, mimo.size(), mimo.data());
+  size_t pos = _data.size();
+  _data.resize(pos + sizeof(TLV) + client.getClientDataSize());
 
-  std::vector<uint8_t> sig = client.getClientDataSignature();
-  p.makeClientDataTLV(ClientData::SIGNATURE, sig.size(), sig.data());
+  uint8_t *body = &_data[pos + sizeof(TLV)];
+  uint16_t length = client.writeClientData(body) - body;
 
-  std::vector<uint8_t> sig5 = client.getClientDataSignature5();
-  p.makeClientDataTLV(ClientData::SIGNATURE_5, sig5.size(), sig5.data());
-
-  std::vector<uint8_t> data_size = client.getClientDataDataSize();
-  p.makeClientDataTLV(ClientData::DATA_SIZE, data_size.size(), data_size.data());
-
-  std::vector<uint8_t> m_cnt = client.getClientDataMgntCnt();
-  p.makeClientDataTLV(ClientData::MNGFRM_CNT, m_cnt.size(), m_cnt.data());
-
-  std::vector<uint8_t> c_cnt = client.getClientDataCtrlCnt();
-  p.makeClientDataTLV(ClientData::CTRLFRM_CNT, c_cnt.size(), c_cnt.data());
-
-  std::vector<uint8_t> d_cnt = client.getClientDataDataCnt();
-  p.makeClientDataTLV(ClientData::DATAFRM_CNT, d_cnt.size(), d_cnt.data());
-
-  std::vector<uint8_t> a_cnt = client.getClientDataAuthCnt();
-  p.makeClientDataTLV(ClientData::AUTH_COUNT, a_cnt.size(), a_cnt.data());
-
-  std::vector<uint8_t> last_dt = client.getClientDataLastDT();
-  p.makeClientDataTLV(ClientData::LAST_DT, last_dt.size(), last_dt.data());
-
-  std::vector<uint8_t> probe_dt = client.getClientDataProbeDT();
-  p.makeClientDataTLV(ClientData::PROBE_DT, probe_dt.size(), probe_dt.data());
-
-  uint16_t length = htons((uint16_t)p._data.size());
-  _data.insert(_data.end(), static_cast<uint8_t>(DataValue::CLIENTS));
-  _data.insert(_data.end(), reinterpret_cast<uint8_t *>(&length), reinterpret_cast<uint8_t *>(&length) + sizeof(length));
-  _data.insert(_data.end(), p._data.begin(), p._data.end());
+  TLV tlv;
+  tlv.type = static_cast<uint8_t>(DataValue::CLIENTS);
+  tlv.length = htons(length);
+  memcpy(&_data[pos], &tlv, sizeof(tlv));
+  _data.resize(pos + sizeof(TLV) + length);
 }
 
 void Packet::makeAPDataTLV(APData type, uint16_t len, const uint8_t *data) {
@@ -505,13 +522,11 @@ void Packet::makeLoginResponseTLV(LoginValue type, uint16_t len, const uint8_t *
 }
 
 void Packet::makeLoginResponseBody(LoginResponse type) {
-  uint16_t length = htons(_data.size());
+  TLV body;
+  body.type = static_cast<uint8_t>(type);
+  body.length = htons(size());
 
-  auto type_pos = _data.begin();
-  _data.insert(type_pos, static_cast<uint8_t>(type));
-
-  auto length_pos = _data.begin() + sizeof(type);
-  _data.insert(length_pos, reinterpret_cast<uint8_t *>(&length), reinterpret_cast<uint8_t *>(&length) + sizeof(length));
+  prepend(reinterpret_cast<uint8_t *>(&body), sizeof(body));
 }
 
 void Packet::makeLoginResponseBodyHeader() {
@@ -519,21 +534,19 @@ void Packet::makeLoginResponseBodyHeader() {
 
   b.type = Messages::S2C_LOGIN_RESPONSE;
   b.product = Product::SENSOR;
-  b.length = htons(_data.size());
+  b.length = htons(size());
   b.res1 = 0;
   b.res2 = 0;
 
-  _data.insert(_data.begin(), reinterpret_cast<uint8_t *>(&b), reinterpret_cast<uint8_t *>(&b) + sizeof(b));
+  prepend(reinterpret_cast<uint8_t *>(&b), sizeof(b));
 }
 
 void Packet::makeDataResponseBody(DataResponse type) {
-  uint16_t length = htons(_data.size());
-
-  auto type_pos = _data.begin();
-  _data.insert(type_pos, static_cast<uint8_t>(type));
+  TLV body;
+  body.type = static_cast<uint8_t>(type);
+  body.length = htons(size());
 
-  auto length_pos = _data.begin() + sizeof(type);
-  _data.insert(length_pos, reinterpret_cast<uint8_t *>(&length), reinterpret_cast<uint8_t *>(&length) + sizeof(length));
+  prepend(reinterpret_cast<uint8_t *>(&body), sizeof(body));
 }
 
 void Packet::makeDataResponseBodyHeader() {
@@ -541,11 +554,11 @@ void Packet::makeDataResponseBodyHeader() {
 
   b.type = Messages::S2C_DATA_RESPONSE;
   b.product = Product::SENSOR;
-  b.length = htons(_data.size());
+  b.length = htons(size());
   b.res1 = 0;
   b.res2 = 0;
 
-  _data.insert(_data.begin(), reinterpret_cast<uint8_t *>(&b), reinterpret_cast<uint8_t *>(&b) + sizeof(b));
+  prepend(reinterpret_cast<uint8_t *>(&b), sizeof(b));
 }
 
 void Packet::makeHeader(uint16_t send_seq) {
@@ -559,16 +572,17 @@ void Packet::makeHeader(uint16_t send_seq) {
   h.seq = htons(send_seq);
   h.flags = flags;
   h.offset = 0;
+  h.option = 0;
   h.nonce = 0;
   h.subtype = Protocol::SWMP;
   h.res = 0;
-  h.length = htons(_data.size());
+  h.length = htons(size());
 
-  _data.insert(_data.begin(), reinterpret_cast<uint8_t *>(&h), reinterpret_cast<uint8_t *>(&h) + sizeof(h));
+  prepend(reinterpret_cast<uint8_t *>(&h), sizeof(h));
 }
 
-void Packet::print() {
-  HEADER *header = reinterpret_cast<HEADER *>(&_data[0]);
+void PacketView::print() const {
+  const HEADER *header = reinterpret_cast<const HEADER *>(&data()[0]);
 
   fmt::print("+ HEADER --------------\n");
   fmt::print("| version: {:02x}\n", (*header).version);
@@ -582,7 +596,7 @@ void Packet::print() {
   fmt::print("| res    : {:02x}\n", (*header).res);
   fmt::print("| length : {:04x}\n", ntohs((*header).length));
 
-  BODYHEADER *bodyheader = reinterpret_cast<BODYHEADER *>(&_data[sizeof(*header)]);
+  const BODYHEADER *bodyheader = reinterpret_cast<const BODYHEADER *>(&data()[sizeof(*header)]);
 
   fmt::print("+ BODYHEADER ----------\n");
   fmt::print("| type   : {:02x}\n", static_cast<uint8_t>((*bodyheader).type));
@@ -592,7 +606,7 @@ void Packet::print() {
   fmt::print("| res2   : {:02x}\n", (*bodyheader).res2);
   fmt::print("+----------------------\n");
 
-  TLV *body = reinterpret_cast<TLV *>(&_data[sizeof(*header) + sizeof(*bodyheader)]);
+  const TLV *body = reinterpret_cast<const TLV *>(&data()[sizeof(*header) + sizeof(*bodyheader)]);
 
   fmt::print("+ BODY ----------------\n");
   fmt::print("| type   : {:02x}\n", (*body).type);
@@ -602,14 +616,14 @@ void Packet::print() {
   uint16_t total_len = ntohs((*body).length);
   uint16_t cur_len = 0;
   while (cur_len < total_len) {
-    TLV *tlv = reinterpret_cast<TLV *>(&_data[sizeof(*header) + sizeof(*bodyheader) + 3 + cur_len]);
+    const TLV *tlv = reinterpret_cast<const TLV *>(&data()[sizeof(*header) + sizeof(*bodyheader) + 3 + cur_len]);
     fmt::print("+ TLV ----------------\n");
     fmt::print("| type   : {:02x}\n", (*tlv).type);
     fmt::print("| length : {:04x}\n", ntohs((*tlv).length));
     for (int i = 0; i < ntohs((*tlv).length); i++) {
-      fmt::print("{:02x} ", _data[sizeof(*header) + sizeof(*bodyheader) + 3 + cur_len + 3 + i]);
+      fmt::print("{:02x} ", data()[sizeof(*header) + sizeof(*bodyheader) + 3 + cur_len + 3 + i]);
     }
     fmt::print("\n+----------------------\n");
     cur_len += 3 + ntohs((*tlv).length);
   }
-}
\ No newline at end of file
+}
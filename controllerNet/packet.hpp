@@ -2,6 +2,7 @@
 #define _WIPS_STRESS_PACKET_HPP_
 
 #include "ap.hpp"
+#include "aria_keycache.hpp"
 #include "client.hpp"
 #include "optional.hpp"
 #include "protocol.hpp"
@@ -59,31 +60,78 @@ struct SensorInfo {
   uint8_t model = 0;
 };
 
+/// per thread free list of packet buffers, each with room for the largest frame
+class PacketBufferPool {
+public:
+  static constexpr size_t MAX_POOLED = 64; // buffers kept per thread, the rest are freed
+
+  static std::vector<uint8_t> acquire();
+  static void release(std::vector<uint8_t> &&buf);
+
+private:
+  static std::vector<std::vector<uint8_t>> &local();
+};
+
+/// read-only window over a frame owned elsewhere (a Packet or the receive buffer), cheap to copy
+class PacketView {
+private:
+  const uint8_t *_ptr;
+  size_t _len;
+
+public:
+  PacketView(const uint8_t *data, size_t len);
+
+  size_t size() const;
+  const uint8_t *data() const;
+
+  uint16_t getSeq() const;
+  uint16_t getHeaderLength() const;
+  Messages getBodyHeaderType() const;
+  uint16_t getBodyHeaderLength() const;
+  uint8_t getBodyType() const;
+  std::vector<uint8_t> getAuthCode() const;
+  tl::optional<uint32_t> getNonce() const;
+  tl::optional<uint32_t> getSensorID() const;
+  tl::optional<ConnectionMode> getMode() const;
+
+  void print() const;
+};
+
 class Packet {
+public:
+  static constexpr size_t HEADROOM = sizeof(HEADER) + sizeof(BODYHEADER) + sizeof(TLV); // room for the make*Header() calls
+  static constexpr size_t TAILROOM = 32 + 16;                                            // SHA-256 digest + a CBC padding block
+  static constexpr size_t MAX_BODY = 8192;                                               // pooled buffers fit this, larger packets grow
+  static constexpr size_t BUFFER_SIZE = HEADROOM + MAX_BODY + TAILROOM;
+
 private:
   std::vector<uint8_t> _data;
+  size_t _head = 0; // first byte of the packet, the bytes before it are headroom
+
+  void prepend(const uint8_t *buf, size_t len);
+  bool growForEncrypt(uint32_t &plain_len);
+  void writeEncryptedHeader(uint16_t nonce);
 
 public:
   Packet();
+  Packet(const Packet &other);
+  Packet(Packet &&other) noexcept;
+  Packet &operator=(const Packet &other);
+  Packet &operator=(Packet &&other) noexcept;
   ~Packet();
 
-  void insert(uint8_t *buf, size_t len);
+  void insert(const uint8_t *buf, size_t len);
 
   size_t size();
   uint8_t *data();
-
-  uint16_t getSeq();
-  uint16_t getHeaderLength();
-  Messages getBodyHeaderType();
-  uint16_t getBodyHeaderLength();
-  uint8_t getBodyType();
-  std::vector<uint8_t> getAuthCode();
-  tl::optional<uint32_t> getNonce();
-  tl::optional<uint32_t> getSensorID();
-  tl::optional<ConnectionMode> getMode();
+  PacketView view(); // valid until the packet is modified or destroyed
 
   void encrypt(const std::string &shared_key);
-  tl::optional<Packet> decrypt(const std::string &shared_key);
+  void encrypt(AriaKeyCache &keys); // round keys come from the connection's cache
+  static void encryptBatch(std::vector<Packet> &packets, AriaKeyCache &keys);
+  static size_t cipherLength(size_t plain_len); // body length after encrypt() adds the digest and padding
+  static tl::optional<Packet> decrypt(const PacketView &frame, const std::string &shared_key);
+  static tl::optional<Packet> decrypt(const PacketView &frame, AriaKeyCache &keys);
 
   void makeSensorID(const uint32_t &sensor_id);
   void makeSensorMAC(const uint64_t &mac);
@@ -106,8 +154,6 @@ public:
   void makeDataResponseBody(DataResponse type);
   void makeDataResponseBodyHeader();
   void makeHeader(uint16_t send_seq);
-
-  void print();
 };
 
 #endif /* _WIPS_STRESS_PACKET_HPP_ */
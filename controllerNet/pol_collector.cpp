@@ -1,19 +1,10 @@
 #include "pol_collector.hpp"
 #include <fmt/format.h>
-#include <thread>
 
 PolCollector::PolCollector() {}
 
 PolCollector::~PolCollector() {}
 
-void PolCollector::run() {
-  pthread_setname_np(pthread_self(), "PolCOllector");
-
-  while (true) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-  }
-}
-
 void PolCollector::setSEpollRef(std::shared_ptr<SEpoll<SocketManager>> sepoll_ref) { //
   _sepoll_ref = sepoll_ref;
 }
@@ -23,8 +14,24 @@ void PolCollector::setTotalSockMansRef(std::shared_ptr<std::vector<std::shared_p
 }
 
 void PolCollector::setSockMan(std::shared_ptr<SocketManager> sockman) { //
-  _sockmans.push_back(sockman);
+  _sockmans.emplace_back(sockman, sockman->getSockGeneration());
   _sepoll_ref->setReadFunc(
       sockman->getSock(), [](int fd, short what, void *arg) -> void { static_cast<SocketManager *>(arg)->configReadFunc(fd, what); },
       sockman.get(), EPOLLIN);
+  // the config frames may have arrived together with the mode frame and already sit in the reassembler
+  _sepoll_ref->raiseEvent(sockman->getSock(), EPOLLIN);
+}
+
+// reactor thread. the connections closed since their handoff, their slot may already carry a new one still logging in
+std::vector<std::shared_ptr<SocketManager>> PolCollector::takeReleasedSockMans() {
+  std::vector<std::shared_ptr<SocketManager>> released;
+  for (auto it = _sockmans.begin(); it != _sockmans.end(); /**/) {
+    if (it->first->getSockGeneration() != it->second || it->first->getMode() != ConnectionMode::CONFIG) {
+      released.push_back(it->first);
+      it = _sockmans.erase(it);
+    } else {
+      it++;
+    }
+  }
+  return released;
 }
\ No newline at end of file
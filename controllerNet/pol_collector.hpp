@@ -7,6 +7,7 @@
 #include <nlohmann/json.hpp>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 class SocketManager;
@@ -16,18 +17,17 @@ public:
 private:
   std::shared_ptr<SEpoll<SocketManager>> _sepoll_ref;
   std::shared_ptr<std::vector<std::shared_ptr<SocketManager>>> _total_sockmans_ref;
-  std::vector<std::shared_ptr<SocketManager>> _sockmans;
+  std::vector<std::pair<std::shared_ptr<SocketManager>, uint64_t>> _sockmans; // with the socket generation it was handed over on
 
 protected:
 public:
   PolCollector();
   ~PolCollector();
 
-  void run();
-
   void setSEpollRef(std::shared_ptr<SEpoll<SocketManager>> sepoll_ref);
   void setTotalSockMansRef(std::shared_ptr<std::vector<std::shared_ptr<SocketManager>>> total_sockmans_ref);
   void setSockMan(std::shared_ptr<SocketManager> sockman);
+  std::vector<std::shared_ptr<SocketManager>> takeReleasedSockMans();
 
 private:
 protected:
@@ -0,0 +1,85 @@
+#ifndef _REASSEMBLER_HPP_
+#define _REASSEMBLER_HPP_
+
+#include "packet.hpp"
+#include <arpa/inet.h>
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+#include <vector>
+
+/// cuts a received byte stream into HEADER + body frames. not thread safe
+class FrameReassembler {
+public:
+  enum class Result { FRAME, NEED_MORE, OVERSIZED };
+
+private:
+  std::vector<uint8_t> buf_;
+  size_t head_ = 0; // first unparsed byte
+  size_t tail_ = 0; // end of received bytes
+  size_t max_frame_;
+
+protected:
+public:
+  FrameReassembler(size_t max_frame = 8192);
+
+  /// returns room for at least len more bytes, commit() what was written into it
+  uint8_t *prepare(size_t len);
+  void commit(size_t len);
+
+  /// points frame at the next complete frame and consumes it, valid until the next prepare()
+  Result next(const uint8_t *&frame, size_t &len);
+
+  size_t pending() const;
+  void clear();
+
+private:
+protected:
+};
+
+inline FrameReassembler::FrameReassembler(size_t max_frame) : max_frame_(max_frame) {}
+
+inline uint8_t *FrameReassembler::prepare(size_t len) {
+  if (head_ == tail_) {
+    head_ = tail_ = 0;
+  } else if (head_ > 0 && buf_.size() - tail_ < len) { // move the partial frame to the front
+    memmove(&buf_[0], &buf_[head_], tail_ - head_);
+    tail_ -= head_;
+    head_ = 0;
+  }
+  if (buf_.size() - tail_ < len) {
+    buf_.resize(tail_ + len);
+  }
+  return &buf_[tail_];
+}
+
+inline void FrameReassembler::commit(size_t len) { tail_ += len; }
+
+inline FrameReassembler::Result FrameReassembler::next(const uint8_t *&frame, size_t &len) {
+  size_t avail = tail_ - head_;
+  if (avail < sizeof(HEADER)) {
+    return Result::NEED_MORE;
+  }
+  uint16_t body_len;
+  memcpy(&body_len, &buf_[head_] + offsetof(HEADER, length), sizeof(body_len));
+  size_t frame_len = sizeof(HEADER) + ntohs(body_len);
+  if (frame_len > max_frame_) {
+    return Result::OVERSIZED;
+  }
+  if (avail < frame_len) {
+    return Result::NEED_MORE;
+  }
+  frame = &buf_[head_];
+  len = frame_len;
+  head_ += frame_len;
+  return Result::FRAME;
+}
+
+inline size_t FrameReassembler::pending() const { return tail_ - head_; }
+
+inline void FrameReassembler::clear() {
+  head_ = 0;
+  tail_ = 0;
+}
+
+#endif /* _REASSEMBLER_HPP_ */
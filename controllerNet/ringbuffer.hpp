@@ -0,0 +1,102 @@
+#ifndef _RINGBUFFER_HPP_
+#define _RINGBUFFER_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <string.h>
+#include <sys/uio.h>
+#include <vector>
+
+/// byte ring buffer, grows by doubling and never shrinks. not thread safe
+class RingBuffer {
+public:
+private:
+  std::vector<uint8_t> buf_;
+  size_t head_ = 0; // first queued byte
+  size_t size_ = 0; // queued bytes
+
+protected:
+public:
+  RingBuffer(size_t capacity = 4096);
+
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+
+  void push(const uint8_t *data, size_t len);
+  void consume(size_t len);
+  void clear();
+
+  /// fills up to two iovecs with the queued bytes, returns the count
+  int peek(struct iovec *iov) const;
+
+private:
+  void reserve(size_t need);
+
+protected:
+};
+
+inline RingBuffer::RingBuffer(size_t capacity) : buf_(capacity < 16 ? 16 : capacity) {}
+
+inline size_t RingBuffer::size() const { return size_; }
+
+inline size_t RingBuffer::capacity() const { return buf_.size(); }
+
+inline bool RingBuffer::empty() const { return size_ == 0; }
+
+inline void RingBuffer::push(const uint8_t *data, size_t len) {
+  reserve(size_ + len);
+  size_t tail = (head_ + size_) % buf_.size();
+  size_t first = std::min(len, buf_.size() - tail);
+  memcpy(&buf_[tail], data, first);
+  memcpy(&buf_[0], data + first, len - first);
+  size_ += len;
+}
+
+inline void RingBuffer::consume(size_t len) {
+  if (len >= size_) {
+    clear();
+    return;
+  }
+  head_ = (head_ + len) % buf_.size();
+  size_ -= len;
+}
+
+inline void RingBuffer::clear() {
+  head_ = 0;
+  size_ = 0;
+}
+
+inline int RingBuffer::peek(struct iovec *iov) const {
+  if (size_ == 0) {
+    return 0;
+  }
+  size_t first = std::min(size_, buf_.size() - head_);
+  iov[0].iov_base = const_cast<uint8_t *>(&buf_[head_]);
+  iov[0].iov_len = first;
+  if (first == size_) {
+    return 1;
+  }
+  iov[1].iov_base = const_cast<uint8_t *>(&buf_[0]);
+  iov[1].iov_len = size_ - first;
+  return 2;
+}
+
+inline void RingBuffer::reserve(size_t need) {
+  if (need <= buf_.size()) {
+    return;
+  }
+  size_t capacity = buf_.size();
+  while (capacity < need) {
+    capacity *= 2;
+  }
+  // unwrap into the new storage so head_ starts at 0
+  std::vector<uint8_t> grown(capacity);
+  size_t first = std::min(size_, buf_.size() - head_);
+  memcpy(&grown[0], &buf_[head_], first);
+  memcpy(&grown[first], &buf_[0], size_ - first);
+  buf_.swap(grown);
+  head_ = 0;
+}
+
+#endif /* _RINGBUFFER_HPP_ */
@@ -0,0 +1,50 @@
+#ifndef _SESSION_SNAPSHOT_HPP_
+#define _SESSION_SNAPSHOT_HPP_
+
+#include "ap.hpp"
+#include "client.hpp"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/// one AP of the snapshot, its clients are clients[first_client .. first_client + client_count)
+struct SessionAP {
+  AP ap;
+  uint64_t hash = 0; // getAPDataHash()
+  size_t first_client = 0;
+  size_t client_count = 0;
+};
+
+struct SessionClient {
+  Client client;
+  uint64_t hash = 0; // getClientDataHash()
+};
+
+/// a client is a record per AP, the same MAC seen under two BSSIDs is sent twice
+struct SessionClientKey {
+  uint64_t bssid = 0; // band + BSSID, like AP::bssid_
+  uint64_t client_mac = 0;
+
+  bool operator==(const SessionClientKey &other) const { return bssid == other.bssid && client_mac == other.client_mac; }
+};
+
+struct SessionClientKeyHash {
+  size_t operator()(const SessionClientKey &key) const { return static_cast<size_t>(key.bssid * 0x9e3779b97f4a7c15ULL ^ key.client_mac); }
+};
+
+/*
+ * merged AP/client DB of one session tick.
+ * WlanProvider builds it once per tick and never modifies it afterwards, every DATA connection serialises from the
+ * same instance. connections hold it through SessionSnapshotPtr, so the next tick can replace it while an older
+ * one is still being sent.
+ */
+class SessionSnapshot {
+public:
+  uint64_t tick = 0;
+  std::vector<SessionAP> aps;
+  std::vector<SessionClient> clients;
+};
+
+using SessionSnapshotPtr = std::shared_ptr<const SessionSnapshot>;
+
+#endif /* _SESSION_SNAPSHOT_HPP_ */
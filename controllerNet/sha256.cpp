@@ -13,7 +13,177 @@ const unsigned int SHA256::sha256_k[64] = // UL = uint32
      0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
 
+/*
+ * hardware paths, picked at run time:
+ *   - SHA-NI (sha256rnds2/msg1/msg2) for transform(), whenever the CPU has it
+ *   - AVX2 for digestMany() without SHA-NI: 8 messages side by side, one per 32-bit lane
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86_ENGINE
+
+static bool DetectSHANI() {
+  __builtin_cpu_init();
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ebx & bit_SHA) && __builtin_cpu_supports("sse4.1");
+}
+
+static bool DetectAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+// chosen on first use, SHA256::useEngines() narrows them to compare engines
+static bool &UseSHANI() {
+  static bool use = DetectSHANI();
+  return use;
+}
+
+static bool &UseAVX2() {
+  static bool use = DetectAVX2();
+  return use;
+}
+
+__attribute__((target("sha,sse4.1"))) static void TransformSHANI(const unsigned int *k, unsigned int *h, const unsigned char *message,
+                                                                 unsigned int block_nb) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h[0]));
+  __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h[4]));
+  tmp = _mm_shuffle_epi32(tmp, 0xb1);             // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1b);       // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);    // CDGH
+
+  for (unsigned int b = 0; b < block_nb; b++, message += 64) {
+    __m128i abef = state0;
+    __m128i cdgh = state1;
+    __m128i w[4];
+    for (int i = 0; i < 4; i++) {
+      w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(message + 16 * i)), mask);
+    }
+#pragma GCC unroll 16
+    for (int g = 0; g < 16; g++) {
+      __m128i msg = _mm_add_epi32(w[g % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(&k[4 * g])));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      msg = _mm_shuffle_epi32(msg, 0x0e);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+      if (g < 12) { // schedule w[4g+16 .. 4g+19] into the slot just used
+        __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(w[g % 4], w[(g + 1) % 4]), _mm_alignr_epi8(w[(g + 3) % 4], w[(g + 2) % 4], 4));
+        w[g % 4] = _mm_sha256msg2_epu32(t, w[(g + 3) % 4]);
+      }
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);       // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xb1);    // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xf0); // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);    // ABEF
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&h[0]), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&h[4]), state1);
+}
+
+#define AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// up to 8 messages, lane i hashes data[i]. the padded tail of every lane is built on the stack
+__attribute__((target("avx2"))) static void DigestManyAVX2(const unsigned int *k, const unsigned char *const *data, const size_t *len,
+                                                           size_t n, unsigned char (*output)[32]) {
+  static const unsigned int iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  unsigned char tail[8][128];
+  size_t full[8], total[8], max_blocks = 0;
+  for (size_t l = 0; l < 8; l++) {
+    size_t ln = l < n ? len[l] : 0;
+    size_t rem = ln % 64;
+    full[l] = ln / 64;
+    size_t tail_blocks = rem + 9 > 64 ? 2 : 1;
+    total[l] = l < n ? full[l] + tail_blocks : 0;
+    memset(tail[l], 0, sizeof(tail[l]));
+    if (l < n) {
+      memcpy(tail[l], data[l] + full[l] * 64, rem);
+    }
+    tail[l][rem] = 0x80;
+    unsigned long long bits = static_cast<unsigned long long>(ln) << 3;
+    for (int i = 0; i < 8; i++) {
+      tail[l][tail_blocks * 64 - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    if (total[l] > max_blocks) {
+      max_blocks = total[l];
+    }
+  }
+
+  __m256i h[8];
+  for (int i = 0; i < 8; i++) {
+    h[i] = _mm256_set1_epi32(iv[i]);
+  }
+  for (size_t b = 0; b < max_blocks; b++) {
+    const unsigned char *p[8];
+    int active[8];
+    for (size_t l = 0; l < 8; l++) {
+      active[l] = b < total[l] ? -1 : 0;
+      p[l] = b < full[l] ? data[l] + b * 64 : tail[l] + (b < total[l] ? (b - full[l]) * 64 : 0);
+    }
+    __m256i w[64];
+    for (int j = 0; j < 16; j++) {
+      unsigned int v[8];
+      for (int l = 0; l < 8; l++) {
+        memcpy(&v[l], p[l] + 4 * j, 4);
+        v[l] = __builtin_bswap32(v[l]);
+      }
+      w[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(v));
+    }
+    for (int j = 16; j < 64; j++) {
+      __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(w[j - 15], 7), AVX2_ROTR(w[j - 15], 18)), _mm256_srli_epi32(w[j - 15], 3));
+      __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(w[j - 2], 17), AVX2_ROTR(w[j - 2], 19)), _mm256_srli_epi32(w[j - 2], 10));
+      w[j] = _mm256_add_epi32(_mm256_add_epi32(s0, s1), _mm256_add_epi32(w[j - 7], w[j - 16]));
+    }
+    __m256i a = h[0], bb = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int j = 0; j < 64; j++) {
+      __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(e, 6), AVX2_ROTR(e, 11)), AVX2_ROTR(e, 25));
+      __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(hh, s1), _mm256_add_epi32(ch, _mm256_set1_epi32(k[j]))), w[j]);
+      __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(a, 2), AVX2_ROTR(a, 13)), AVX2_ROTR(a, 22));
+      __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, bb), _mm256_and_si256(a, c)), _mm256_and_si256(bb, c));
+      __m256i t2 = _mm256_add_epi32(s0, maj);
+      hh = g;
+      g = f;
+      f = e;
+      e = _mm256_add_epi32(d, t1);
+      d = c;
+      c = bb;
+      bb = a;
+      a = _mm256_add_epi32(t1, t2);
+    }
+    // lanes past their last block keep their state
+    __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(active));
+    __m256i wv[8] = {a, bb, c, d, e, f, g, hh};
+    for (int i = 0; i < 8; i++) {
+      h[i] = _mm256_add_epi32(h[i], _mm256_and_si256(wv[i], mask));
+    }
+  }
+
+  for (int i = 0; i < 8; i++) {
+    unsigned int v[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(v), h[i]);
+    for (size_t l = 0; l < n; l++) {
+      unsigned int be = __builtin_bswap32(v[l]);
+      memcpy(&output[l][4 * i], &be, 4);
+    }
+  }
+}
+#endif
+
 void SHA256::transform(const unsigned char *message, unsigned int block_nb) {
+#ifdef SHA256_X86_ENGINE
+  if (UseSHANI()) {
+    TransformSHANI(sha256_k, m_h, message, block_nb);
+    return;
+  }
+#endif
   uint32 w[64];
   uint32 wv[8];
   uint32 t1, t2;
@@ -134,3 +304,47 @@ int8_t *SHA256::sha256(void *ptr, int32_t length) {
     sprintf(buf + i * 2, "%02x", digest[i]);
   return (int8_t *)buf;
 }
+
+void SHA256::digest(const void *ptr, size_t length, uint8_t *output) {
+  SHA256 ctx;
+  ctx.init();
+  ctx.update(static_cast<const unsigned char *>(ptr), length);
+  ctx.final(output);
+}
+
+void SHA256::digestMany(const uint8_t *const *data, const size_t *length, size_t n, uint8_t (*output)[DIGEST_SIZE]) {
+#ifdef SHA256_X86_ENGINE
+  if (!UseSHANI() && UseAVX2()) { // SHA-NI hashes one message faster than AVX2 hashes eight
+    for (size_t i = 0; i < n; i += 8) {
+      DigestManyAVX2(sha256_k, data + i, length + i, n - i < 8 ? n - i : 8, output + i);
+    }
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    digest(data[i], length[i], output[i]);
+  }
+}
+
+const char *SHA256::engine() {
+#ifdef SHA256_X86_ENGINE
+  if (UseSHANI()) {
+    return "sha-ni";
+  }
+  if (UseAVX2()) {
+    return "scalar, avx2 multi-buffer";
+  }
+#endif
+  return "scalar";
+}
+
+const char *SHA256::useEngines(bool sha_ni, bool avx2) {
+#ifdef SHA256_X86_ENGINE
+  UseSHANI() = sha_ni && DetectSHANI();
+  UseAVX2() = avx2 && DetectAVX2();
+#else
+  (void)sha_ni;
+  (void)avx2;
+#endif
+  return engine();
+}
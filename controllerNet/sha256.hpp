@@ -1,5 +1,6 @@
 #ifndef SHA256_H
 #define SHA256_H
+#include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <string>
@@ -14,10 +15,17 @@ protected:
   static const unsigned int SHA224_256_BLOCK_SIZE = (512 / 8);
 
 public:
+  /* incremental: init(), update() as often as needed, final() */
   void init();
   void update(const unsigned char *message, unsigned int len);
   void final(unsigned char *digest);
   static const unsigned int DIGEST_SIZE = (256 / 8);
+  static void digest(const void *ptr, size_t length, uint8_t *output);
+  /* n independent messages, 8 at a time on AVX2 when there is no SHA-NI */
+  static void digestMany(const uint8_t *const *data, const size_t *length, size_t n, uint8_t (*output)[DIGEST_SIZE]);
+  static const char *engine();
+  /* tests and benchmarks: limit the engines to the allowed ones the CPU has, returns engine() */
+  static const char *useEngines(bool sha_ni, bool avx2);
   std::string sha256(std::string input);
   template <typename T> void sha256_bin(T ptr, int32_t length, uint8_t *output);
   int8_t *sha256(void *ptr, int32_t length);
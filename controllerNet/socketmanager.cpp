@@ -3,130 +3,18 @@
 #include "sys/socket.h"
 #include "var_util.hpp"
 #include <fmt/format.h>
+#include <algorithm>
+#include <errno.h>
 #include <iomanip>
 #include <netinet/in.h>
 #include <smart_io.hpp>
 #include <stdio.h>
 #include <string.h>
 
-#if 1                           // Smart IO Function
-template <typename... _String_> //
-static bool check_key(nlohmann::json &j, _String_... args) {
-  for (auto &a : {args...}) {
-    auto v = j.value(a, nlohmann::json());
-    if (v.is_null()) {
-      return false;
-    }
-  }
-  return true;
-}
-
-#if 0
-static void test_check_key() {
-  nlohmann::json j;
-  j["a"] = 1;
-  j["b"] = "2";
-
-  cout << check_key(j, "a") << endl;
-  cout << check_key(j, "b") << endl;
-  cout << check_key(j, "c") << endl;
-  cout << check_key(j, "a", "b") << endl;
-  cout << check_key(j, "a", "b", "c") << endl;
-}
-#endif
-
-/// AP 정보 조회
-static nlohmann::json get_aps() {
-  SmartIO io("get", "ipc:///tmp/ap_get.uds");
-  nlohmann::json aps;
-  aps["1"] = "{}"_json; // 2GHz
-  aps["2"] = "{}"_json; // 5GHz
-
-  auto res = io.getall([&](nlohmann::json &j) { //
-    if (!check_key(j, "band", "bssid")) {
-      assert("missing key: band + bssid");
-      return;
-    }
-    auto band = std::to_string(j["band"].get<uint8_t>());
-    auto bssid = j["bssid"].get<std::string>();
-    aps[band][bssid] = j;
-  });
-  return aps;
-}
-
-/// AP-단말 세션 정보 조회
-static nlohmann::json get_ap_client() {
-  SmartIO io("get", "ipc:///tmp/ap_client_get.uds");
-  nlohmann::json ap_client;
-
-  auto res = io.getall([&](nlohmann::json &j) { //
-    if (!check_key(j, "band", "bssid", "clients")) {
-      assert("missing key: band + bssid + clients");
-      return;
-    }
-    ap_client.push_back(j);
-  });
-  return ap_client;
-}
-
-/// 단말 정보 조회
-static nlohmann::json get_clients() {
-  SmartIO io("get", "ipc:///tmp/client_get.uds");
-  nlohmann::json clients;
-
-  auto res = io.getall([&](nlohmann::json &j) { //
-    if (!check_key(j, "client")) {
-      assert("missing key: client");
-      return;
-    }
-    auto client = j["client"].get<std::string>();
-    clients[client] = j;
-  });
-  return clients;
-}
-
-/// AP-단말 정보 + 세션 정보를 하나의 json으로 취합
-static nlohmann::json ap_client_data() {
-  auto ap_client_db = get_ap_client(); // ap-client session 정보
-  auto ap_db = get_aps();              // ap 정보
-  auto client_db = get_clients();      // 단말 정보
-
-  for (auto &item : ap_client_db.items()) {
-    auto &ac = item.value();
-    auto band = std::to_string(ac["band"].get<uint8_t>());
-    auto bssid = ac["bssid"].get<std::string>();
-    auto &clients = ac["clients"];
-
-    auto ap_info = ap_db[band].value(bssid, nlohmann::json());
-    if (!ap_info.is_null()) {
-      //
-      // AP 정보 업데이트
-      //
-      ac.update(ap_info);
-    }
-    if (!clients.is_null()) {
-      for (auto &item : clients.items()) {
-        auto &client = item.value();
-        auto client_info = client_db.value(client, nlohmann::json());
-        if (!client_info.is_null()) {
-          //
-          // 단말 정보 업데이트
-          //
-          client = client_info;
-        } else {
-          client = nlohmann::json{{"client", client}};
-        }
-      }
-    }
-  }
-
-  return ap_client_db;
-}
-#endif // ~Smart IO Function
-
 SocketManager::SocketManager(ConnectionType type, const char *sharedkey) {
   _type = type;
   _sharedkey = sharedkey;
+  _keys.setSharedKey(_sharedkey);
 }
 
 SocketManager::~SocketManager() {}
@@ -135,7 +23,28 @@ bool SocketManager::isConnected() { return false; }
 
 int SocketManager::getSock() { return _sock; };
 
-void SocketManager::setSock(int sock) { _sock = sock; }
+// a new socket starts the connection over : login state, mode and sequence numbers belong to the old one
+void SocketManager::setSock(int sock) {
+  std::lock_guard<std::mutex> g(_send_mutex);
+  if (sock != _sock) { // bytes queued for the old connection are meaningless on the new one
+    _send_buf.clear();
+    _send_armed = false;
+    _recv_frames.clear();
+    _session_resync = true;
+    _state = ConnectionState::INIT;
+    _mode = ConnectionMode::UNKNOWN;
+    _recv_seq = 0;
+    _send_seq = 0;
+    {
+      std::lock_guard<std::mutex> gs(_signal_mutex);
+      _send_signal_types.clear();
+    }
+    _sock_generation++;
+  }
+  _sock = sock;
+}
+
+uint64_t SocketManager::getSockGeneration() { return _sock_generation; }
 
 ConnectionState SocketManager::getState() { return _state; };
 
@@ -147,65 +56,99 @@ void SocketManager::setWlanProvider(std::shared_ptr<WlanProvider> wp) { _wp = wp
 
 void SocketManager::setPolCollector(std::shared_ptr<PolCollector> pc) { _pc = pc; }
 
+void SocketManager::setSEpollRef(std::shared_ptr<SEpoll<SocketManager>> sepoll_ref) { _sepoll_ref = sepoll_ref; }
+
+void SocketManager::setSendHighWaterMark(size_t bytes) {
+  std::lock_guard<std::mutex> g(_send_mutex);
+  _send_high_water = bytes;
+}
+
+// capped at the largest frame the 16 bit length field can describe. a single record larger than the limit still goes out alone
+void SocketManager::setMaxFrameSize(size_t bytes) {
+  size_t largest = sizeof(HEADER) + (UINT16_MAX & ~static_cast<size_t>(15)); // whole cipher blocks
+  _max_frame_size = std::min(bytes, largest);
+}
+
+size_t SocketManager::getQueuedBytes() {
+  std::lock_guard<std::mutex> g(_send_mutex);
+  return _send_buf.size();
+}
+
+bool SocketManager::isSendBackpressured() {
+  std::lock_guard<std::mutex> g(_send_mutex);
+  return _send_buf.size() >= _send_high_water;
+}
+
+void SocketManager::printSendStats() {
+  std::lock_guard<std::mutex> g(_send_mutex);
+  uint64_t stall_time_us = _stall_time_us;
+  if (_send_armed) { // include the stall in progress
+    stall_time_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _stall_start).count();
+  }
+  fmt::print("send stats ({}) queued: {} peak: {} sent: {} stalls: {} stall time: {}ms backpressure: {}\n", _sock, _send_buf.size(),
+             _queued_peak, _sent_bytes, _stall_count, stall_time_us / 1000, _backpressure_count.load());
+}
+
 void SocketManager::loginReadFunc(int fd, short what) {
   fd = fd;
 
   if (what & EPOLLIN) {
-    auto decrypted = recvData();
-
-    if (!decrypted) {
-      // TODO: 연결 끊김 처리
-      return;
-    }
-    if (_state == ConnectionState::VERIFY_MAC) {
-      auto nonce = (*decrypted).getNonce();
-      if (nonce) {
-        calcControllerAuthCode(*nonce);
-      } else {
-        fmt::print("No Nonce\n");
-        _state = ConnectionState::INIT;
-        return;
-      }
-      sendLoginChallenge();
-      _state = ConnectionState::LOGIN_REQUEST_CHALLENGE;
-    } else if (_state == ConnectionState::LOGIN_REQUEST_CHALLENGE) {
-      auto auth_code = (*decrypted).getAuthCode();
-      if (!auth_code.empty()) {
-        if (!memcmp(_s_auth, auth_code.data(), sizeof(_s_auth))) {
-          _state = ConnectionState::LOGIN_SUCCESS;
-          sendLoginSuccess();
-          fmt::print("Login Success ({})\n", _sock);
+    // a login step can arrive together with the next one, stop once the mode is known and leave the rest to the mode's handler
+    tl::optional<Packet> decrypted;
+    beginRecvWakeup();
+    while (_mode == ConnectionMode::UNKNOWN && (decrypted = recvData())) {
+      PacketView frame = decrypted->view();
+      if (_state == ConnectionState::VERIFY_MAC) {
+        auto nonce = frame.getNonce();
+        if (nonce) {
+          calcControllerAuthCode(*nonce);
         } else {
-          fmt::print("Failed verify auth code\n");
-          (*decrypted).print();
+          fmt::print("No Nonce\n");
+          _state = ConnectionState::INIT;
+          break;
+        }
+        sendLoginChallenge();
+        _state = ConnectionState::LOGIN_REQUEST_CHALLENGE;
+      } else if (_state == ConnectionState::LOGIN_REQUEST_CHALLENGE) {
+        auto auth_code = frame.getAuthCode();
+        if (!auth_code.empty()) {
+          if (!memcmp(_s_auth, auth_code.data(), sizeof(_s_auth))) {
+            _state = ConnectionState::LOGIN_SUCCESS;
+            sendLoginSuccess();
+            fmt::print("Login Success ({})\n", _sock);
+          } else {
+            fmt::print("Failed verify auth code\n");
+            frame.print();
+          }
+        } else {
+          fmt::print("No auth code\n");
+          frame.print();
+          _state = ConnectionState::INIT;
+          break;
+        }
+      } else if (_state == ConnectionState::LOGIN_SUCCESS) {
+        auto sensor_id = frame.getSensorID();
+        if (sensor_id) {
+          fmt::print("get sensor_id: {} ({})\n", *sensor_id, _sock);
+          _sensor_id = *sensor_id;
+          _state = ConnectionState::SET_SENSOR_ID;
+        } else {
+          fmt::print("not find sensor_id");
+          frame.print();
+          _state = ConnectionState::INIT;
+          break;
+        }
+      } else if (_state == ConnectionState::SET_SENSOR_ID) {
+        _mode = *frame.getMode();
+        fmt::print("get mode : {} ({})\n", _mode, _sock);
+        if (_mode == ConnectionMode::DATA) {
+          _state = ConnectionState::REQUEST_DATA;
+        } else if (_mode == ConnectionMode::CONFIG) {
+          _state = ConnectionState::SET_CONFIG;
         }
-      } else {
-        fmt::print("No auth code\n");
-        (*decrypted).print();
-        _state = ConnectionState::INIT;
-        return;
-      }
-    } else if (_state == ConnectionState::LOGIN_SUCCESS) {
-      auto sensor_id = (*decrypted).getSensorID();
-      if (sensor_id) {
-        fmt::print("get sensor_id: {} ({})\n", *sensor_id, _sock);
-        _sensor_id = *sensor_id;
-        _state = ConnectionState::SET_SENSOR_ID;
-      } else {
-        fmt::print("not find sensor_id");
-        (*decrypted).print();
-        _state = ConnectionState::INIT;
-        return;
-      }
-    } else if (_state == ConnectionState::SET_SENSOR_ID) {
-      _mode = *(*decrypted).getMode();
-      fmt::print("get mode : {} ({})\n", _mode, _sock);
-      if (_mode == ConnectionMode::DATA) {
-        _state = ConnectionState::REQUEST_DATA;
-      } else if (_mode == ConnectionMode::CONFIG) {
-        _state = ConnectionState::SET_CONFIG;
       }
     }
+    endRecvWakeup();
   }
 }
 
@@ -227,6 +170,10 @@ void SocketManager::dataWriteFunc(int fd, short what) {
   fd = fd;
 
   if (what | EPOLLOUT) {
+    if (!flushSendBuffer()) { // signals stay pending until the backlog is gone
+      armSendBuffer();
+      return;
+    }
     checkSendSignalType();
   }
 }
@@ -235,37 +182,39 @@ void SocketManager::configReadFunc(int fd, short what) {
   fd = fd;
 
   if (what | EPOLLIN) {
-    auto recvpacket = recvData();
-    if (!recvpacket) {
-      return;
-    }
-    // recvpacket->print();
-    switch (static_cast<SetConfig>(recvpacket->getBodyType())) {
-    case SetConfig::LIST_SINGLE:
-    case SetConfig::LIST_START:
-    case SetConfig::LIST_CONTINUE:
-    case SetConfig::LIST_FINISH:
-      recvConfigData(*recvpacket);
-      break;
-    case SetConfig::FIRMWARE:
-      break;
-    default:
-      break;
+    tl::optional<Packet> recvpacket;
+    beginRecvWakeup();
+    while ((recvpacket = recvData())) {
+      PacketView frame = recvpacket->view();
+      // frame.print();
+      switch (static_cast<SetConfig>(frame.getBodyType())) {
+      case SetConfig::LIST_SINGLE:
+      case SetConfig::LIST_START:
+      case SetConfig::LIST_CONTINUE:
+      case SetConfig::LIST_FINISH:
+        recvConfigData(frame);
+        break;
+      case SetConfig::FIRMWARE:
+        break;
+      default:
+        break;
+      }
     }
+    endRecvWakeup();
   }
 }
 
-void SocketManager::recvConfigData(Packet p) {
+void SocketManager::recvConfigData(PacketView p) {
   fmt::print("receive config data start ({})\n", _sock);
 
   uint16_t pos = sizeof(HEADER) + sizeof(BODYHEADER) + sizeof(TLV);
   size_t total_size = p.size();
 
   while (pos < total_size) {
-    TLV *tlv = reinterpret_cast<TLV *>(&p.data()[pos]);
+    const TLV *tlv = reinterpret_cast<const TLV *>(&p.data()[pos]);
     SetConfigList tlv_type = static_cast<SetConfigList>(tlv->type);
     uint16_t tlv_len = ntohs(tlv->length);
-    uint8_t *tlv_val = static_cast<uint8_t *>(&p.data()[pos + sizeof(TLV)]);
+    const uint8_t *tlv_val = &p.data()[pos + sizeof(TLV)];
 
     switch (tlv_type) {
     case SetConfigList::AUTH_AP:
@@ -324,7 +273,7 @@ void SocketManager::recvConfigData(Packet p) {
   fmt::print("receive config data end ({})\n", _sock);
 }
 
-void SocketManager::setWhiteList(uint8_t *data, uint16_t length, SetConfigList setcfg) {
+void SocketManager::setWhiteList(const uint8_t *data, uint16_t length, SetConfigList setcfg) {
   uint16_t offset = 0;
   std::string mac_str = "";
 
@@ -369,7 +318,7 @@ void SocketManager::setWhiteList(uint8_t *data, uint16_t length, SetConfigList s
   }
 }
 
-void SocketManager::setThreatPolicy(uint8_t *data, uint16_t length) {
+void SocketManager::setThreatPolicy(const uint8_t *data, uint16_t length) {
   uint16_t offset = 0;
 
   while (offset < length) {
@@ -408,7 +357,7 @@ void SocketManager::setThreatPolicy(uint8_t *data, uint16_t length) {
   }
 }
 
-void SocketManager::setBlockList(uint8_t *data, uint16_t length) {
+void SocketManager::setBlockList(const uint8_t *data, uint16_t length) {
   uint16_t offset = 0;
 
   while (offset < length) {
@@ -430,17 +379,17 @@ void SocketManager::setBlockList(uint8_t *data, uint16_t length) {
   }
 }
 
-void SocketManager::setTimeSync(uint8_t *data, uint16_t length) {
+void SocketManager::setTimeSync(const uint8_t *data, uint16_t length) {
   data = data;
   length = length;
 }
 
-void SocketManager::setGeneralConfig(uint8_t *data, uint16_t length) {
+void SocketManager::setGeneralConfig(const uint8_t *data, uint16_t length) {
   data = data;
   length = length;
 }
 
-void SocketManager::setHash(uint8_t *data, uint16_t length, SetConfigList setcfg) {
+void SocketManager::setHash(const uint8_t *data, uint16_t length, SetConfigList setcfg) {
   switch (setcfg) {
   case SetConfigList::AUTH_AP_HASH:
     PublicMemory::_auth_aps_hash->clear();
@@ -788,6 +737,7 @@ void SocketManager::flushConfigData(SetConfigList setcfg) {
 }
 
 void SocketManager::pushSendSignalType(SendSignalType sst) { //
+  std::lock_guard<std::mutex> g(_signal_mutex);
   auto search = std::find(_send_signal_types.begin(), _send_signal_types.end(), sst);
   if (search == _send_signal_types.end()) {
     _send_signal_types.push_back(sst);
@@ -796,8 +746,10 @@ void SocketManager::pushSendSignalType(SendSignalType sst) { //
 
 void SocketManager::checkSendSignalType() {
   std::list<SendSignalType> temp_send_signal_types;
-  temp_send_signal_types.assign(_send_signal_types.begin(), _send_signal_types.end());
-  _send_signal_types.clear();
+  {
+    std::lock_guard<std::mutex> g(_signal_mutex);
+    temp_send_signal_types.swap(_send_signal_types);
+  }
 
   /* hash signal storage */
   std::vector<SendSignalType> hash_signal_types;
@@ -837,52 +789,29 @@ void SocketManager::checkSendSignalType() {
   // ~Send Hash Data
 }
 
+// returns the next complete frame, reading only while none is buffered. never blocks
 tl::optional<Packet> SocketManager::recvData() {
-  Packet p;
-
-  int ret = 0;
-  int flags = 0;
-  uint32_t size = 0;
+  const uint8_t *frame = nullptr;
+  size_t frame_len = 0;
 
-  uint8_t buf[8192] = {0x00};
-
-  /* get header data */
-  // fmt::print("start header receive ({})\n", _sock);
-  memset(buf, 0x00, 8192);
-  do {
-    ret = recv(_sock, buf + size, sizeof(HEADER) - size, flags);
-    if (ret < 0) {
-      fmt::print("receive < 0 ! ({})\n", _sock);
-      return tl::nullopt;
-    } else if (ret == 0) {
-      fmt::print("receive == 0 ! ({})\n", _sock);
+  while (true) {
+    auto res = _recv_frames.next(frame, frame_len);
+    if (res == FrameReassembler::Result::FRAME) {
+      break;
+    } else if (res == FrameReassembler::Result::OVERSIZED) {
+      fmt::print("Err frame too large ({})\n", _sock);
+      _recv_frames.clear();
+      _state = ConnectionState::INIT;
       return tl::nullopt;
     }
-    size += ret;
-  } while (size != sizeof(HEADER));
-  p.insert(buf, size);
-
-  /* get body, tlv data */
-  // fmt::print("start body receive ({})\n", _sock);
-  size = 0;
-  memset(buf, 0x00, 8192);
-  uint32_t header_length = p.getHeaderLength();
-  do {
-    ret = recv(_sock, buf + size, header_length - size, flags);
-    if (ret < 0) {
-      return tl::nullopt;
-      fmt::print("receive < 0 !! ({})\n", _sock);
-    } else if (ret == 0) {
-      fmt::print("receive == 0 !! ({})\n", _sock);
+    if (!fillRecvBuffer()) {
       return tl::nullopt;
     }
-    size += ret;
-  } while (size != header_length);
-  p.insert(buf, size);
-
-  // fmt::print("end packet receive (%d)\n", _sock);
+  }
+  _wakeup_frames++;
 
-  auto decrypted = p.decrypt(_sharedkey);
+  // decrypted straight out of the reassembly buffer, the frame stays valid until the next fillRecvBuffer()
+  auto decrypted = Packet::decrypt(PacketView(frame, frame_len), _keys);
   if (!decrypted) {
     fmt::print("Err decrypt\n");
     _state = ConnectionState::INIT;
@@ -896,7 +825,7 @@ tl::optional<Packet> SocketManager::recvData() {
   }
 #endif
 
-  if (!verifyPacketHeaderLength(*decrypted)) {
+  if (!verifyPacketHeaderLength(decrypted->view())) {
     fmt::print("Err verifyPacketHeaderLength\n");
     _state = ConnectionState::INIT;
     return tl::nullopt;
@@ -905,11 +834,129 @@ tl::optional<Packet> SocketManager::recvData() {
   return decrypted;
 }
 
+// one large recv, so a burst of frames is decoded from a single syscall. false when nothing new arrived
+bool SocketManager::fillRecvBuffer() {
+  const size_t chunk = 64 * 1024;
+  while (true) {
+    ssize_t ret = recv(_sock, _recv_frames.prepare(chunk), chunk, MSG_DONTWAIT);
+    if (ret > 0) {
+      _recv_frames.commit(ret);
+      return true;
+    } else if (ret == 0) {
+      fmt::print("receive == 0 ! ({})\n", _sock);
+      return false;
+    } else if (errno != EINTR) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        fmt::print("receive < 0 ! ({})\n", _sock);
+      }
+      return false;
+    }
+  }
+}
+
+void SocketManager::beginRecvWakeup() { _wakeup_frames = 0; }
+
+void SocketManager::endRecvWakeup() {
+  _recv_wakeups++;
+  _recv_frames_total += _wakeup_frames;
+  if (_wakeup_frames == 0) {
+    _recv_empty_wakeups++;
+  }
+  uint32_t max = _recv_frames_max.load();
+  while (_wakeup_frames > max && !_recv_frames_max.compare_exchange_weak(max, _wakeup_frames)) {
+  }
+}
+
+uint64_t SocketManager::getRecvFrames() { return _recv_frames_total.load(); }
+
+void SocketManager::printRecvStats() {
+  uint64_t wakeups = _recv_wakeups.load();
+  uint64_t frames = _recv_frames_total.load();
+  fmt::print("recv stats ({}) wakeups: {} frames: {} frames/wakeup: {:.2f} max: {} empty: {}\n", _sock, wakeups, frames,
+             wakeups ? static_cast<double>(frames) / wakeups : 0.0, _recv_frames_max.load(), _recv_empty_wakeups.load());
+}
+
 void SocketManager::sendData(Packet &p) {
   // fmt::print("sendData start ({}) ({})\n", p.size(), _sock);
-  send(_sock, p.data(), p.size(), 0);
-  // int ret = send(_sock, p.data(), p.size(), 0);
-  // fmt::print("sendData end ({}) ({})\n", ret, _sock);
+  queueSend(p.data(), p.size());
+}
+
+// writes what the socket takes right now and queues the rest, EPOLLOUT is armed only while bytes are queued
+void SocketManager::queueSend(const uint8_t *data, size_t len) {
+  {
+    std::lock_guard<std::mutex> g(_send_mutex);
+    if (_sock == -1) {
+      return;
+    }
+    size_t offset = 0;
+    if (_send_buf.empty()) { // nothing queued, so writing directly keeps the byte order
+      while (offset < len) {
+        ssize_t ret = send(_sock, data + offset, len - offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret > 0) {
+          offset += ret;
+          _sent_bytes += ret;
+        } else if (ret == -1 && errno == EINTR) {
+          continue;
+        } else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          break;
+        } else {
+          fmt::print("send error: {} ({})\n", strerror(errno), _sock);
+          return;
+        }
+      }
+      if (offset == len) {
+        return;
+      }
+      _stall_start = std::chrono::steady_clock::now();
+      _stall_count++;
+    }
+    _send_buf.push(data + offset, len - offset);
+    _queued_peak = std::max(_queued_peak, _send_buf.size());
+    if (_send_armed) {
+      return;
+    }
+    _send_armed = true;
+  }
+  armSendBuffer();
+}
+
+// returns true when the send buffer is empty
+bool SocketManager::flushSendBuffer() {
+  std::lock_guard<std::mutex> g(_send_mutex);
+  while (!_send_buf.empty()) {
+    struct iovec iov[2];
+    struct msghdr msg;
+    memset(&msg, 0x00, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = _send_buf.peek(iov);
+    ssize_t ret = sendmsg(_sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (ret > 0) {
+      _send_buf.consume(ret);
+      _sent_bytes += ret;
+    } else if (ret == -1 && errno == EINTR) {
+      continue;
+    } else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return false;
+    } else {
+      fmt::print("send error: {} ({})\n", strerror(errno), _sock);
+      _send_buf.clear();
+    }
+  }
+  if (_send_armed) {
+    _stall_time_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _stall_start).count();
+    _send_armed = false;
+  }
+  return true;
+}
+
+// dataWriteFunc flushes the queue once the socket is writable again
+void SocketManager::armSendBuffer() {
+  if (!_sepoll_ref) {
+    return;
+  }
+  _sepoll_ref->setWriteFunc(
+      _sock, [](int fd, short what, void *arg) -> void { static_cast<SocketManager *>(arg)->dataWriteFunc(fd, what); }, this,
+      EPOLLOUT | EPOLLONESHOT);
 }
 
 void SocketManager::calcControllerAuthCode(const uint32_t &nonce) {
@@ -940,31 +987,31 @@ void SocketManager::calcSensorAuthCode(const uint32_t &nonce) {
   memcpy(_s_auth, ret.data(), sizeof(_s_auth));
 }
 
-bool SocketManager::verifyPacket(Packet p) {
+bool SocketManager::verifyPacket(PacketView p) {
   p = p;
 #if 0
   // debug log
-  auto verifySeq = [&recv_seq = recv_seq_, this](Packet p) {
+  auto verifySeq = [&recv_seq = recv_seq_, this](PacketView p) {
     bool success = verifyPacketSeq(p, recv_seq);
     // debug log
     return success ? unit_(p) : nullopt;
   };
-  auto verifyHeaderLength = [this](Packet p) {
+  auto verifyHeaderLength = [this](PacketView p) {
     bool success = verifyPacketHeaderLength(p);
     // debug log
     return success ? unit_(p) : nullopt;
   };
-  auto verifyHash = [this](Packet p) {
+  auto verifyHash = [this](PacketView p) {
     bool success = verifyPacketHash(p);
     // debug log
     return success ? unit_(p) : nullopt;
   };
-  auto verifyBodyHeaderType = [state = state_, this](Packet p) {
+  auto verifyBodyHeaderType = [state = state_, this](PacketView p) {
     bool success = verifyPacketBodyHeaderType(p, state);
     // debug log
     return success ? unit_(p) : nullopt;
   };
-  auto verifyBodyHeaderLength = [this](Packet p) {
+  auto verifyBodyHeaderLength = [this](PacketView p) {
     bool success = verifyPacketBodyHeaderLength(p);
     // debug log
     return success ? unit_(p) : nullopt;
@@ -979,7 +1026,7 @@ bool SocketManager::verifyPacket(Packet p) {
   return true;
 }
 
-bool SocketManager::verifyPacketSeq(Packet p, uint16_t &recv_seq) {
+bool SocketManager::verifyPacketSeq(PacketView p, uint16_t &recv_seq) {
   uint16_t seq = p.getSeq();
   // debug log
   if (recv_seq == 65535)
@@ -994,7 +1041,7 @@ bool SocketManager::verifyPacketSeq(Packet p, uint16_t &recv_seq) {
   return false;
 }
 
-bool SocketManager::verifyPacketHeaderLength(Packet p) {
+bool SocketManager::verifyPacketHeaderLength(PacketView p) {
   if (p.getHeaderLength() == p.size() - sizeof(HEADER)) {
     return true;
   }
@@ -1003,12 +1050,12 @@ bool SocketManager::verifyPacketHeaderLength(Packet p) {
   return false;
 }
 
-bool SocketManager::verifyPacketHash(Packet p) {
+bool SocketManager::verifyPacketHash(PacketView p) {
   p = p;
   return true;
 }
 
-bool SocketManager::verifyPacketBodyHeaderType(Packet p, ConnectionState state) {
+bool SocketManager::verifyPacketBodyHeaderType(PacketView p, ConnectionState state) {
   if (state == ConnectionState::LOGIN_REQUEST_START)
     return p.getBodyHeaderType() == Messages::S2C_LOGIN_RESPONSE;
   if (state == ConnectionState::LOGIN_REQUEST_CHALLENGE)
@@ -1018,7 +1065,7 @@ bool SocketManager::verifyPacketBodyHeaderType(Packet p, ConnectionState state)
   return false;
 }
 
-bool SocketManager::verifyPacketBodyHeaderLength(Packet p) {
+bool SocketManager::verifyPacketBodyHeaderLength(PacketView p) {
   if (p.getBodyHeaderLength() == p.size() - sizeof(HEADER) - sizeof(BODYHEADER))
     return true;
   return false;
@@ -1039,7 +1086,7 @@ void SocketManager::sendLoginChallenge() {
   p.makeLoginResponseBodyHeader();
   p.makeHeader(_send_seq++);
 
-  p.encrypt(_sharedkey);
+  p.encrypt(_keys);
 
   sendData(p);
 }
@@ -1051,7 +1098,7 @@ void SocketManager::sendLoginSuccess() {
   p.makeLoginResponseBodyHeader();
   p.makeHeader(_send_seq++);
 
-  p.encrypt(_sharedkey);
+  p.encrypt(_keys);
 
   sendData(p);
 }
@@ -1064,7 +1111,7 @@ void SocketManager::sendMac() {
   send_buf[3] = _mac >> 2 * 8;
   send_buf[4] = _mac >> 1 * 8;
   send_buf[5] = _mac >> 0 * 8;
-  send(_sock, send_buf, 6, 0);
+  queueSend(send_buf, 6);
 }
 
 void SocketManager::sendHashData(std::vector<SendSignalType> signals) {
@@ -1138,37 +1185,136 @@ void SocketManager::sendHashData(std::vector<SendSignalType> signals) {
   p.makeDataResponseBodyHeader();
   p.makeHeader(_send_seq++);
 
-  p.encrypt(_sharedkey);
+  p.encrypt(_keys);
 
   sendData(p);
 }
 
+// serialises the shared snapshot of this tick, only the records this connection has not seen in that form
 void SocketManager::sendSessionData() {
   fmt::print("send session data start ({})\n", _sock);
-  auto sensor_data = ap_client_data();
-  // std::cout << sensor_data.dump(4) << std::endl;
-  if (sensor_data.is_null()) {
+  SessionSnapshotPtr snapshot = _wp->getSessionSnapshot();
+  if (snapshot->aps.empty()) {
     fmt::print("send session data empty ({})\n", _sock);
     return;
   }
-  for (auto a : sensor_data) {
+  if (_session_resync.exchange(false) || _session_pushes % SESSION_FULL_REFRESH == 0) {
+    _session_pushes = 0; // forget what was sent, every record goes out again
+    _sent_aps.clear();
+    _sent_clients.clear();
+  }
+  _session_pushes++;
+
+  size_t sent = 0;
+  std::vector<Packet> batch;
+  batch.reserve(SESSION_BATCH);
+  Packet open; // DATA packet being filled, records are added until the next one would exceed _max_frame_size
+  for (auto &a : snapshot->aps) {
+    if (isSendBackpressured()) { // the peer is not keeping up, records not reached yet stay unsent for the next round
+      closeSessionPacket(batch, open);
+      flushSessionBatch(batch); // already numbered, the sequence must stay contiguous
+      _backpressure_count++;
+      fmt::print("send session data backpressure, queued {} ({})\n", getQueuedBytes(), _sock);
+      return;
+    }
     // send ap
-    AP ap = getAPFromJson(a);
-    sendSessionAPData(ap);
+    if (sessionRecordChanged(_sent_aps, a.ap.bssid_, a.hash)) {
+      openSessionRecord(batch, open, sizeof(TLV) + a.ap.getAPDataSize());
+      open.makeAPData(a.ap);
+      _open_records.aps.emplace_back(a.ap.bssid_, a.hash);
+      sent++;
+    }
     // ~send ap
 
     // send clients
-    auto j_clients = a.value("clients", nlohmann::json());
-    if (j_clients.is_null()) {
-      continue;
-    }
-    for (auto c : j_clients) {
-      Client client = getClientFromJson(c, ap.bssid_, ap.channel_);
-      sendSessionClientData(client);
+    for (size_t i = a.first_client; i < a.first_client + a.client_count; i++) {
+      const SessionClient &c = snapshot->clients[i];
+      SessionClientKey key;
+      key.bssid = c.client.bssid_;
+      key.client_mac = c.client.client_mac_;
+      if (sessionRecordChanged(_sent_clients, key, c.hash)) {
+        openSessionRecord(batch, open, sizeof(TLV) + c.client.getClientDataSize());
+        open.makeClientData(c.client);
+        _open_records.clients.emplace_back(key, c.hash);
+        sent++;
+      }
     }
     // ~send clients
   }
-  fmt::print("send session data end ({})\n", _sock);
+  closeSessionPacket(batch, open);
+  flushSessionBatch(batch);
+  fmt::print("send session data end, {} of {} records ({})\n", sent, snapshot->aps.size() + snapshot->clients.size(), _sock);
+}
+
+// true when the record is new on this connection or its fields changed since the last push. flushSessionBatch()
+// remembers it as sent once its packet is queued
+template <typename Key, typename KeyHash>
+bool SocketManager::sessionRecordChanged(const std::unordered_map<Key, uint64_t, KeyHash> &sent, const Key &key, uint64_t hash) {
+  auto it = sent.find(key);
+  return it == sent.end() || it->second != hash;
+}
+
+// makes room in the open packet for a record of record_len bytes, closing it first when the frame would grow past
+// _max_frame_size. an empty packet is started with the sensor id
+void SocketManager::openSessionRecord(std::vector<Packet> &batch, Packet &open, size_t record_len) {
+  if (open.size() > 0) {
+    size_t plain_len = sizeof(BODYHEADER) + sizeof(TLV) + open.size() + record_len;
+    if (sizeof(HEADER) + Packet::cipherLength(plain_len) <= _max_frame_size) {
+      return;
+    }
+    closeSessionPacket(batch, open);
+  }
+  open.makeSensorID(_sensor_id);
+}
+
+// numbers the open packet and moves it to the batch, a full batch is sent. a packet too large to encrypt is dropped
+// here, before it takes a sequence number, so the peer sees no gap
+void SocketManager::closeSessionPacket(std::vector<Packet> &batch, Packet &open) {
+  if (open.size() == 0) {
+    return;
+  }
+  size_t plain_len = sizeof(BODYHEADER) + sizeof(TLV) + open.size();
+  if (Packet::cipherLength(plain_len) > UINT16_MAX) {
+    fmt::print("drop session packet, {} bytes do not fit a frame ({})\n", plain_len, _sock);
+    open = Packet();
+    _open_records.clear(); // not sent, the next push tries them again
+    return;
+  }
+  open.makeDataResponseBody(DataResponse::DATA);
+  open.makeDataResponseBodyHeader();
+  open.makeHeader(_send_seq++);
+  batch.push_back(std::move(open));
+  open = Packet();
+  _batch_records.aps.insert(_batch_records.aps.end(), _open_records.aps.begin(), _open_records.aps.end());
+  _batch_records.clients.insert(_batch_records.clients.end(), _open_records.clients.begin(), _open_records.clients.end());
+  _open_records.clear();
+  if (batch.size() >= SESSION_BATCH) {
+    flushSessionBatch(batch);
+  }
+}
+
+// encrypts the collected packets in one pass and queues them in sequence order, then remembers their session
+// records as sent
+void SocketManager::flushSessionBatch(std::vector<Packet> &batch) {
+  if (batch.empty()) {
+    return;
+  }
+  size_t packets = batch.size();
+  Packet::encryptBatch(batch, _keys);
+  for (auto &p : batch) {
+    sendData(p);
+  }
+  // closeSessionPacket() keeps oversized packets out, a drop here cannot be told apart per record : resend them all
+  if (batch.size() == packets) {
+    for (auto &r : _batch_records.aps) {
+      _sent_aps[r.first] = r.second;
+    }
+    for (auto &r : _batch_records.clients) {
+      _sent_clients[r.first] = r.second;
+    }
+  }
+  _batch_records.clear();
+  batch.clear();
 }
 
 void SocketManager::sendSessionAPData(AP ap) {
@@ -1180,25 +1326,21 @@ void SocketManager::sendSessionAPData(AP ap) {
   p.makeDataResponseBodyHeader();
   p.makeHeader(_send_seq++);
 
-  p.encrypt(_sharedkey);
+  p.encrypt(_keys);
 
   sendData(p);
 }
 
+// as many APs per packet as _max_frame_size allows
 void SocketManager::sendSessionAPsData(std::vector<AP> aps) {
-  Packet p;
-
-  p.makeSensorID(_sensor_id);
-  for (auto ap : aps) {
-    p.makeAPData(ap);
+  std::vector<Packet> batch;
+  Packet open;
+  for (auto &ap : aps) {
+    openSessionRecord(batch, open, sizeof(TLV) + ap.getAPDataSize());
+    open.makeAPData(ap);
   }
-  p.makeDataResponseBody(DataResponse::DATA);
-  p.makeDataResponseBodyHeader();
-  p.makeHeader(_send_seq++);
-
-  p.encrypt(_sharedkey);
-
-  sendData(p);
+  closeSessionPacket(batch, open);
+  flushSessionBatch(batch);
 }
 
 void SocketManager::sendSessionClientData(Client client) {
@@ -1210,25 +1352,20 @@ void SocketManager::sendSessionClientData(Client client) {
   p.makeDataResponseBodyHeader();
   p.makeHeader(_send_seq++);
 
-  p.encrypt(_sharedkey);
+  p.encrypt(_keys);
 
   sendData(p);
 }
 
 void SocketManager::sendSessionClientsData(std::vector<Client> clients) {
-  Packet p;
-
-  p.makeSensorID(_sensor_id);
-  for (auto client : clients) {
-    p.makeClientData(client);
+  std::vector<Packet> batch;
+  Packet open;
+  for (auto &client : clients) {
+    openSessionRecord(batch, open, sizeof(TLV) + client.getClientDataSize());
+    open.makeClientData(client);
   }
-  p.makeDataResponseBody(DataResponse::DATA);
-  p.makeDataResponseBodyHeader();
-  p.makeHeader(_send_seq++);
-
-  p.encrypt(_sharedkey);
-
-  sendData(p);
+  closeSessionPacket(batch, open);
+  flushSessionBatch(batch);
 }
 
 void SocketManager::sendSensorInfo() {
@@ -1245,60 +1382,7 @@ void SocketManager::sendSensorInfo() {
   p.makeDataResponseBodyHeader();
   p.makeHeader(_send_seq++);
 
-  p.encrypt(_sharedkey);
+  p.encrypt(_keys);
 
   sendData(p);
-}
-
-AP SocketManager::getAPFromJson(nlohmann::json j) {
-  AP ap;
-  ap.bssid_ = static_cast<uint64_t>(j.value("band", 0)) << (8 * 6);
-  ap.bssid_ += mac::string_to_mac(j.value("bssid", "00:00:00:00:00:00"));
-  ap.ssid_ = j.value("ssid", "");
-  ap.channel_ = static_cast<uint8_t>(j.value("frame_channel", 0));
-  ap.rssi_ = static_cast<int8_t>(j.value("rssi", -90));
-  ap.cipher_ = static_cast<uint8_t>(j.value("cipher", 0));
-  ap.auth_ = static_cast<uint8_t>(j.value("auth", 0));
-  ap.ssid_broadcast_ = static_cast<bool>(j.value("ssid_broadcast", false));
-  ap.channel_width_ = static_cast<uint8_t>(j.value("channel_width", 0));
-  ap.wps_ = static_cast<bool>(j.value("wps", false));
-  ap.pmf_ = static_cast<bool>(j.value("pmf", false));
-  ap.media_ = 1;
-  ap.net_type_ = 1;
-  memset(ap.signature_, 0x00, 32);
-  ap.mgnt_count_ = 0;
-  ap.ctrl_count_ = 0;
-  ap.data_count_ = 0;
-  ap.wds_peer_ = 0;
-  memset(ap.support_rate_, 0x00, 16);
-  ap.mcs_ = 0;
-  ap.support_mimo_ = 0;
-  ap.highest_rate_ = 0;
-  ap.spatial_stream_ = 0;
-  ap.guard_interval_ = 0;
-  ap.last_dt_ = 0;
-  ap.probe_dt_ = 0;
-  return ap;
-}
-
-Client SocketManager::getClientFromJson(nlohmann::json j, uint64_t bssid, uint8_t channel) {
-  Client client;
-  client.client_mac_ = mac::string_to_mac(j.value("client", "00:00:00:00:00:00"));
-  client.rssi_ = static_cast<int8_t>(j.value("rssi", -90));
-  client.bssid_ = bssid;
-  client.channel_ = channel;
-  memset(client.eap_id_, 0x00, 64);
-  client.data_rate_ = 0;
-  client.noise_ = -90;
-  client.mimo_ = 0;
-  memset(client.signature_, 0x00, 32);
-  memset(client.signature5_, 0x00, 32);
-  client.data_size_ = 0;
-  client.mgnt_count_ = 0;
-  client.ctrl_count_ = 0;
-  client.data_count_ = 0;
-  client.auth_count_ = 0;
-  client.last_dt_ = 0;
-  client.probe_dt_ = 0;
-  return client;
 }
\ No newline at end of file
@@ -1,32 +1,55 @@
 #ifndef _SOCKETMANAGER_HPP_
 #define _SOCKETMANAGER_HPP_
 
+#include "SEpoll.hpp"
 #include "md5.hpp"
 #include "optional.hpp"
 #include "packet.hpp"
 #include "pol_collector.hpp"
 #include "publicmemory.hpp"
+#include "reassembler.hpp"
+#include "ringbuffer.hpp"
+#include "session_snapshot.hpp"
 #include "wlan_provider.hpp"
+#include <chrono>
 #include <list>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <string>
 #include <sys/epoll.h>
 #include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 class WlanProvider;
 class PolCollector;
 
+// session records of packets not queued yet, with their hashes
+struct SessionRecords {
+  std::vector<std::pair<uint64_t, uint64_t>> aps;
+  std::vector<std::pair<SessionClientKey, uint64_t>> clients;
+
+  void clear() {
+    aps.clear();
+    clients.clear();
+  }
+};
+
 class SocketManager {
 public:
+  static constexpr size_t SESSION_BATCH = 32;        // session packets encrypted together before they are queued
+  static constexpr uint32_t SESSION_FULL_REFRESH = 12; // every 12th session push (once a minute) resends every record
+
 private:
   int _sock = -1;
+  std::atomic<uint64_t> _sock_generation{0}; // bumped by every setSock() that changes the socket, the fd number may be reused
 
   uint32_t _sensor_id = 0;
   uint64_t _mac = 0;
 
   std::string _sharedkey = "";
+  AriaKeyCache _keys; // round keys per nonce derived from _sharedkey
   ConnectionState _state = ConnectionState::INIT;
   ConnectionType _type = ConnectionType::ACCEPT;
   ConnectionMode _mode = ConnectionMode::UNKNOWN;
@@ -38,6 +61,33 @@ private:
 
   std::shared_ptr<WlanProvider> _wp;
   std::shared_ptr<PolCollector> _pc;
+  std::shared_ptr<SEpoll<SocketManager>> _sepoll_ref;
+
+  FrameReassembler _recv_frames{sizeof(HEADER) + UINT16_MAX}; // bounded only by the 16 bit length field
+
+  /* recv metrics */
+  uint32_t _wakeup_frames = 0; // frames decoded in the current read callback
+  std::atomic<uint64_t> _recv_wakeups{0};
+  std::atomic<uint64_t> _recv_frames_total{0};
+  std::atomic<uint64_t> _recv_empty_wakeups{0};
+  std::atomic<uint32_t> _recv_frames_max{0};
+  /* ~recv metrics */
+
+  /* send buffer */
+  std::mutex _send_mutex;
+  RingBuffer _send_buf;
+  size_t _send_high_water = 1024 * 1024; // producers back off above this many queued bytes
+  bool _send_armed = false;              // EPOLLOUT requested for the queued bytes
+  std::chrono::steady_clock::time_point _stall_start;
+  /* ~send buffer */
+
+  /* send metrics */
+  uint64_t _sent_bytes = 0;
+  size_t _queued_peak = 0;
+  uint64_t _stall_count = 0;
+  uint64_t _stall_time_us = 0;
+  std::atomic<uint64_t> _backpressure_count{0};
+  /* ~send metrics */
 
   /* recv data storage */
   nlohmann::json _auth_aps = nlohmann::json({});
@@ -56,6 +106,18 @@ private:
   nlohmann::json _sensor_setting = nlohmann::json({});
   /* ~recv data storage */
 
+  size_t _max_frame_size = Packet::MAX_BODY; // session DATA packets are packed up to this many bytes on the wire
+
+  /* session delta, what the peer last received on this connection */
+  std::unordered_map<uint64_t, uint64_t> _sent_aps;                                  // band + BSSID -> getAPDataHash()
+  std::unordered_map<SessionClientKey, uint64_t, SessionClientKeyHash> _sent_clients; // BSSID + client MAC -> getClientDataHash()
+  SessionRecords _open_records;  // in the open session packet
+  SessionRecords _batch_records; // in the session batch, remembered as sent once the batch is queued
+  uint32_t _session_pushes = 0;
+  std::atomic<bool> _session_resync{true}; // set on a new socket, the next push is a full one
+  /* ~session delta */
+
+  std::mutex _signal_mutex; // pushed from the reactor, consumed on a dispatcher thread
   std::list<SendSignalType> _send_signal_types;
 
 public:
@@ -66,6 +128,7 @@ public:
 
   int getSock();
   void setSock(int sock);
+  uint64_t getSockGeneration();
 
   ConnectionState getState();
   void setState(ConnectionState state);
@@ -74,6 +137,15 @@ public:
 
   void setWlanProvider(std::shared_ptr<WlanProvider> wp);
   void setPolCollector(std::shared_ptr<PolCollector> pc);
+  void setSEpollRef(std::shared_ptr<SEpoll<SocketManager>> sepoll_ref);
+
+  void setSendHighWaterMark(size_t bytes);
+  void setMaxFrameSize(size_t bytes);
+  size_t getQueuedBytes();
+  bool isSendBackpressured();
+  void printSendStats();
+  void printRecvStats();
+  uint64_t getRecvFrames(); // frames decoded so far, by whichever read func owned the socket
 
   void loginReadFunc(int fd, short what);
   void loginWriteFunc(int fd, short what);
@@ -83,33 +155,39 @@ public:
   void pushSendSignalType(SendSignalType sst);
 
 private:
-  void recvConfigData(Packet p);
+  void recvConfigData(PacketView p);
   void checkSendSignalType();
 
-  void setWhiteList(uint8_t *data, uint16_t length, SetConfigList setcfg);
-  void setThreatPolicy(uint8_t *data, uint16_t length);
-  void setBlockList(uint8_t *data, uint16_t length);
-  void setTimeSync(uint8_t *data, uint16_t length);
-  void setGeneralConfig(uint8_t *data, uint16_t length);
-  void setHash(uint8_t *data, uint16_t length, SetConfigList setcfg);
+  void setWhiteList(const uint8_t *data, uint16_t length, SetConfigList setcfg);
+  void setThreatPolicy(const uint8_t *data, uint16_t length);
+  void setBlockList(const uint8_t *data, uint16_t length);
+  void setTimeSync(const uint8_t *data, uint16_t length);
+  void setGeneralConfig(const uint8_t *data, uint16_t length);
+  void setHash(const uint8_t *data, uint16_t length, SetConfigList setcfg);
 
   std::string getThreatPolicyName(uint16_t pol_code);
 
   void flushConfigData(SetConfigList setcfg);
 
   tl::optional<Packet> recvData();
+  bool fillRecvBuffer();
+  void beginRecvWakeup();
+  void endRecvWakeup();
   void sendData(Packet &p);
+  void queueSend(const uint8_t *data, size_t len);
+  bool flushSendBuffer();
+  void armSendBuffer();
 
   void calcControllerAuthCode(const uint32_t &nonce);
   void calcSensorAuthCode(const uint32_t &nonce);
 
   /* verify packet */
-  bool verifyPacket(Packet p);
-  bool verifyPacketSeq(Packet p, uint16_t &recv_seq);
-  bool verifyPacketHeaderLength(Packet p);
-  bool verifyPacketHash(Packet p);
-  bool verifyPacketBodyHeaderType(Packet p, ConnectionState state);
-  bool verifyPacketBodyHeaderLength(Packet p);
+  bool verifyPacket(PacketView p);
+  bool verifyPacketSeq(PacketView p, uint16_t &recv_seq);
+  bool verifyPacketHeaderLength(PacketView p);
+  bool verifyPacketHash(PacketView p);
+  bool verifyPacketBodyHeaderType(PacketView p, ConnectionState state);
+  bool verifyPacketBodyHeaderLength(PacketView p);
 
   void sendLoginChallenge();
   void sendLoginSuccess();
@@ -119,14 +197,17 @@ private:
   void sendHashData(std::vector<SendSignalType> signals);
   void sendSessionData();
 
+  void openSessionRecord(std::vector<Packet> &batch, Packet &open, size_t record_len);
+  void closeSessionPacket(std::vector<Packet> &batch, Packet &open);
+  void flushSessionBatch(std::vector<Packet> &batch);
+  template <typename Key, typename KeyHash>
+  static bool sessionRecordChanged(const std::unordered_map<Key, uint64_t, KeyHash> &sent, const Key &key, uint64_t hash);
+
   void sendSessionAPData(AP ap);
   void sendSessionAPsData(std::vector<AP> aps);
   void sendSessionClientData(Client client);
   void sendSessionClientsData(std::vector<Client> clients);
   void sendSensorInfo();
-
-  AP getAPFromJson(nlohmann::json j);
-  Client getClientFromJson(nlohmann::json j, uint64_t bssid, uint8_t channel);
 };
 
 #endif /* _SOCKETMANAGER_HPP_ */
\ No newline at end of file
@@ -0,0 +1,199 @@
+#ifndef _TLV_SCHEMA_HPP_
+#define _TLV_SCHEMA_HPP_
+
+#include "tlv_writer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+#include <string>
+
+/*
+ * compile-time TLV layouts.
+ * a schema is a list of fields, each binding a struct member to a TLV type, width and byte order.
+ * TLVSchema<...>::encode/decode/hash expand over the list, so every field is inlined in order.
+ *
+ *   using Schema = TLVSchema<TLVScalar<TLV_TYPE(APData::CHANNEL), TLV_MEMBER(AP, channel_)>, ...>;
+ */
+
+#define TLV_TYPE(t) decltype(t), t
+#define TLV_MEMBER(c, m) decltype(&c::m), &c::m
+
+enum class TLVOrder { NETWORK, HOST };
+
+template <typename MP> struct tlv_member;
+template <typename C, typename M> struct tlv_member<M C::*> {
+  using class_type = C;
+  using value_type = M;
+};
+
+template <size_t N> struct tlv_uint;
+template <> struct tlv_uint<1> { using type = uint8_t; };
+template <> struct tlv_uint<2> { using type = uint16_t; };
+template <> struct tlv_uint<4> { using type = uint32_t; };
+template <> struct tlv_uint<8> { using type = uint64_t; };
+
+/// integer, enum or bool member, sizeof(member) bytes
+template <typename TT, TT Type, typename MP, MP Ptr, TLVOrder Order = TLVOrder::NETWORK> struct TLVScalar {
+  using C = typename tlv_member<MP>::class_type;
+  using V = typename tlv_member<MP>::value_type;
+  using U = typename tlv_uint<sizeof(V)>::type;
+  static constexpr uint8_t type = static_cast<uint8_t>(Type);
+
+  static size_t size(const C &) { return sizeof(V); }
+
+  template <typename W> static void encode(const C &c, W &w) {
+    uint8_t buf[sizeof(V)];
+    if (Order == TLVOrder::HOST) {
+      memcpy(buf, &(c.*Ptr), sizeof(V));
+    } else {
+      U u = static_cast<U>(c.*Ptr);
+      for (size_t i = 0; i < sizeof(V); i++) {
+        buf[i] = static_cast<uint8_t>(u >> (8 * (sizeof(V) - 1 - i)));
+      }
+    }
+    w.put(type, buf, sizeof(V));
+  }
+
+  static bool decode(C &c, const uint8_t *v, uint16_t len) {
+    if (len != sizeof(V)) {
+      return false;
+    }
+    if (Order == TLVOrder::HOST) {
+      memcpy(&(c.*Ptr), v, sizeof(V));
+    } else {
+      U u = 0;
+      for (size_t i = 0; i < sizeof(V); i++) {
+        u = static_cast<U>((u << 8) | v[i]);
+      }
+      c.*Ptr = static_cast<V>(u);
+    }
+    return true;
+  }
+};
+
+/// the first N bytes of an array member
+template <typename TT, TT Type, typename MP, MP Ptr, size_t N> struct TLVBytes {
+  using C = typename tlv_member<MP>::class_type;
+  using V = typename tlv_member<MP>::value_type;
+  static_assert(N <= sizeof(V), "TLVBytes wider than its member");
+  static constexpr uint8_t type = static_cast<uint8_t>(Type);
+
+  static size_t size(const C &) { return N; }
+
+  template <typename W> static void encode(const C &c, W &w) { w.put(type, &(c.*Ptr), N); }
+
+  static bool decode(C &c, const uint8_t *v, uint16_t len) {
+    if (len != N) {
+      return false;
+    }
+    memcpy(&(c.*Ptr), v, N);
+    return true;
+  }
+};
+
+/// std::string member, variable length
+template <typename TT, TT Type, typename MP, MP Ptr> struct TLVString {
+  using C = typename tlv_member<MP>::class_type;
+  static constexpr uint8_t type = static_cast<uint8_t>(Type);
+
+  static size_t size(const C &c) { return (c.*Ptr).size(); }
+
+  template <typename W> static void encode(const C &c, W &w) { w.put(type, (c.*Ptr).data(), (c.*Ptr).size()); }
+
+  static bool decode(C &c, const uint8_t *v, uint16_t len) {
+    (c.*Ptr).assign(reinterpret_cast<const char *>(v), len);
+    return true;
+  }
+};
+
+/// 6 byte MAC held in the low bits of a uint64_t member
+template <typename TT, TT Type, typename MP, MP Ptr> struct TLVMAC {
+  using C = typename tlv_member<MP>::class_type;
+  static constexpr uint8_t type = static_cast<uint8_t>(Type);
+
+  static size_t size(const C &) { return 6; }
+
+  template <typename W> static void encode(const C &c, W &w) { w.putMAC(type, c.*Ptr); }
+
+  static bool decode(C &c, const uint8_t *v, uint16_t len) {
+    if (len != 6) {
+      return false;
+    }
+    uint64_t mac = 0;
+    for (int i = 0; i < 6; i++) {
+      mac = (mac << 8) | v[i];
+    }
+    c.*Ptr = mac;
+    return true;
+  }
+};
+
+/// band (1: 2.4GHz, 2: 5GHz, from the channel member) followed by a 6 byte MAC
+template <typename TT, TT Type, typename MP, MP Ptr, typename CP, CP Channel> struct TLVBandMAC {
+  using C = typename tlv_member<MP>::class_type;
+  static constexpr uint8_t type = static_cast<uint8_t>(Type);
+
+  static size_t size(const C &) { return 7; }
+
+  template <typename W> static void encode(const C &c, W &w) { w.putBandMAC(type, c.*Channel < 14 ? 1 : 2, c.*Ptr); }
+
+  // the band follows from the channel, only the MAC is stored
+  static bool decode(C &c, const uint8_t *v, uint16_t len) {
+    if (len != 7) {
+      return false;
+    }
+    return TLVMAC<TT, Type, MP, Ptr>::decode(c, v + 1, 6);
+  }
+};
+
+template <typename... Fields> struct TLVSchema {
+  /// encoded size of all fields including their TLV headers
+  template <typename C> static size_t size(const C &c) {
+    size_t n = 0;
+    int expand[] = {0, (n += 3 + Fields::size(c), 0)...};
+    (void)expand;
+    return n;
+  }
+
+  /// writes every field in schema order, out needs size(c) bytes. returns the end
+  template <typename C> static uint8_t *encode(const C &c, uint8_t *out) {
+    TLVWriter w(out);
+    int expand[] = {0, (Fields::encode(c, w), 0)...};
+    (void)expand;
+    return w.pos();
+  }
+
+  /// hash of the bytes encode() would write, nothing is written
+  template <typename C> static uint64_t hash(const C &c) {
+    TLVHasher h;
+    int expand[] = {0, (Fields::encode(c, h), 0)...};
+    (void)expand;
+    return h.value();
+  }
+
+  /// fills the fields found in data, in any order. unknown types are skipped, false on a malformed record
+  template <typename C> static bool decode(C &c, const uint8_t *data, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+      if (len - pos < 3) {
+        return false;
+      }
+      uint8_t type = data[pos];
+      uint16_t vlen = static_cast<uint16_t>((data[pos + 1] << 8) | data[pos + 2]);
+      pos += 3;
+      if (len - pos < vlen) {
+        return false;
+      }
+      bool ok = true;
+      int expand[] = {0, (type == Fields::type ? (ok = Fields::decode(c, data + pos, vlen) && ok, 0) : 0)...};
+      (void)expand;
+      if (!ok) {
+        return false;
+      }
+      pos += vlen;
+    }
+    return true;
+  }
+};
+
+#endif /* _TLV_SCHEMA_HPP_ */
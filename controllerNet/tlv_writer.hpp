@@ -0,0 +1,93 @@
+#ifndef _TLV_WRITER_HPP_
+#define _TLV_WRITER_HPP_
+
+#include <cstdint>
+#include <string.h>
+
+/// writes type(1) + length(2, network order) + value records into a caller sized buffer
+class TLVWriter {
+public:
+private:
+  uint8_t *pos_;
+
+protected:
+public:
+  explicit TLVWriter(uint8_t *out) : pos_(out) {}
+
+  uint8_t *pos() const { return pos_; }
+
+  void put(uint8_t type, const void *data, uint16_t len) {
+    putHeader(type, len);
+    memcpy(pos_, data, len);
+    pos_ += len;
+  }
+
+  /// 6 byte MAC, most significant byte first
+  void putMAC(uint8_t type, uint64_t mac) {
+    putHeader(type, 6);
+    writeMAC(mac);
+  }
+
+  /// band byte followed by the 6 byte MAC
+  void putBandMAC(uint8_t type, uint8_t band, uint64_t mac) {
+    putHeader(type, 7);
+    *pos_++ = band;
+    writeMAC(mac);
+  }
+
+private:
+  void putHeader(uint8_t type, uint16_t len) {
+    pos_[0] = type;
+    pos_[1] = len >> 8;
+    pos_[2] = len;
+    pos_ += 3;
+  }
+
+  void writeMAC(uint64_t mac) {
+    for (int i = 5; i >= 0; i--) {
+      *pos_++ = static_cast<uint8_t>(mac >> (8 * i));
+    }
+  }
+
+protected:
+};
+
+/// TLVWriter's interface, folds the bytes it would write into a 64 bit FNV-1a hash instead
+class TLVHasher {
+public:
+private:
+  uint64_t h_ = 0xcbf29ce484222325ULL;
+
+protected:
+public:
+  uint64_t value() const { return h_; }
+
+  void put(uint8_t type, const void *data, uint16_t len) {
+    uint8_t header[3] = {type, static_cast<uint8_t>(len >> 8), static_cast<uint8_t>(len)};
+    mix(header, sizeof(header));
+    mix(static_cast<const uint8_t *>(data), len);
+  }
+
+  void putMAC(uint8_t type, uint64_t mac) {
+    uint8_t buf[3 + 6];
+    TLVWriter(buf).putMAC(type, mac);
+    mix(buf, sizeof(buf));
+  }
+
+  void putBandMAC(uint8_t type, uint8_t band, uint64_t mac) {
+    uint8_t buf[3 + 7];
+    TLVWriter(buf).putBandMAC(type, band, mac);
+    mix(buf, sizeof(buf));
+  }
+
+private:
+  void mix(const uint8_t *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      h_ = (h_ ^ p[i]) * 0x100000001b3ULL;
+    }
+  }
+
+protected:
+};
+
+#endif /* _TLV_WRITER_HPP_ */
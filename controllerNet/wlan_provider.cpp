@@ -1,30 +1,133 @@
 #include "wlan_provider.hpp"
+#include "mac_util.hpp"
 #include <fmt/format.h>
-#include <thread>
+#include <smart_io.hpp>
+#include <string.h>
 
-WlanProvider::WlanProvider() {}
+#if 1                           // Smart IO Function
+template <typename... _String_> //
+static bool check_key(nlohmann::json &j, _String_... args) {
+  for (auto &a : {args...}) {
+    auto v = j.value(a, nlohmann::json());
+    if (v.is_null()) {
+      return false;
+    }
+  }
+  return true;
+}
 
-WlanProvider::~WlanProvider() {}
+#if 0
+static void test_check_key() {
+  nlohmann::json j;
+  j["a"] = 1;
+  j["b"] = "2";
+
+  cout << check_key(j, "a") << endl;
+  cout << check_key(j, "b") << endl;
+  cout << check_key(j, "c") << endl;
+  cout << check_key(j, "a", "b") << endl;
+  cout << check_key(j, "a", "b", "c") << endl;
+}
+#endif
 
-void WlanProvider::run() {
-  pthread_setname_np(pthread_self(), "WlanProvider");
+/// AP 정보 조회
+static nlohmann::json get_aps() {
+  SmartIO io("get", "ipc:///tmp/ap_get.uds");
+  nlohmann::json aps;
+  aps["1"] = "{}"_json; // 2GHz
+  aps["2"] = "{}"_json; // 5GHz
 
-  uint32_t loop_cnt = 1;
-  while (true) {
-    // Scheduler Job
-    if (loop_cnt % 5 == 0) {
-      pushSendSignalType(SendSignalType::SESSIONS);
+  auto res = io.getall([&](nlohmann::json &j) { //
+    if (!check_key(j, "band", "bssid")) {
+      assert("missing key: band + bssid");
+      return;
     }
-    // ~Scheduler Job
+    auto band = std::to_string(j["band"].get<uint8_t>());
+    auto bssid = j["bssid"].get<std::string>();
+    aps[band][bssid] = j;
+  });
+  return aps;
+}
 
-    checkSendSignalType();
+/// AP-단말 세션 정보 조회
+static nlohmann::json get_ap_client() {
+  SmartIO io("get", "ipc:///tmp/ap_client_get.uds");
+  nlohmann::json ap_client;
 
-    loop_cnt++;
-    if (loop_cnt > 400000000) {
-      loop_cnt = 0;
+  auto res = io.getall([&](nlohmann::json &j) { //
+    if (!check_key(j, "band", "bssid", "clients")) {
+      assert("missing key: band + bssid + clients");
+      return;
+    }
+    ap_client.push_back(j);
+  });
+  return ap_client;
+}
+
+/// 단말 정보 조회
+static nlohmann::json get_clients() {
+  SmartIO io("get", "ipc:///tmp/client_get.uds");
+  nlohmann::json clients;
+
+  auto res = io.getall([&](nlohmann::json &j) { //
+    if (!check_key(j, "client")) {
+      assert("missing key: client");
+      return;
+    }
+    auto client = j["client"].get<std::string>();
+    clients[client] = j;
+  });
+  return clients;
+}
+
+/// AP-단말 정보 + 세션 정보를 하나의 json으로 취합
+static nlohmann::json ap_client_data() {
+  auto ap_client_db = get_ap_client(); // ap-client session 정보
+  auto ap_db = get_aps();              // ap 정보
+  auto client_db = get_clients();      // 단말 정보
+
+  for (auto &item : ap_client_db.items()) {
+    auto &ac = item.value();
+    auto band = std::to_string(ac["band"].get<uint8_t>());
+    auto bssid = ac["bssid"].get<std::string>();
+    auto &clients = ac["clients"];
+
+    auto ap_info = ap_db[band].value(bssid, nlohmann::json());
+    if (!ap_info.is_null()) {
+      //
+      // AP 정보 업데이트
+      //
+      ac.update(ap_info);
+    }
+    if (!clients.is_null()) {
+      for (auto &item : clients.items()) {
+        auto &client = item.value();
+        auto client_info = client_db.value(client, nlohmann::json());
+        if (!client_info.is_null()) {
+          //
+          // 단말 정보 업데이트
+          //
+          client = client_info;
+        } else {
+          client = nlohmann::json{{"client", client}};
+        }
+      }
     }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
   }
+
+  return ap_client_db;
+}
+#endif // ~Smart IO Function
+
+WlanProvider::WlanProvider() {}
+
+WlanProvider::~WlanProvider() {}
+
+// schedules the periodic jobs on the SEpoll timer, call after setSEpollRef()
+void WlanProvider::start() {
+  // Scheduler Job
+  _sepoll_ref->addTimer(5000, [this]() -> void { pushSendSignalType(SendSignalType::SESSIONS); }, 5000);
+  // ~Scheduler Job
 }
 
 void WlanProvider::setSEpollRef(std::shared_ptr<SEpoll<SocketManager>> sepoll_ref) { //
@@ -36,23 +139,54 @@ void WlanProvider::setTotalSockMansRef(std::shared_ptr<std::vector<std::shared_p
 }
 
 void WlanProvider::setSockMan(std::shared_ptr<SocketManager> sockman) { //
-  _sockmans.push_back(sockman);
+  _sockmans.emplace_back(sockman, sockman->getSockGeneration());
 }
 
-void WlanProvider::pushSendSignalType(SendSignalType sst) { //
-  auto search = std::find(_send_signal_types.begin(), _send_signal_types.end(), sst);
-  if (search == _send_signal_types.end()) {
-    _send_signal_types.push_back(sst);
+// reactor thread. the connections closed since their handoff, their slot may already carry a new one still logging in
+std::vector<std::shared_ptr<SocketManager>> WlanProvider::takeReleasedSockMans() {
+  std::vector<std::shared_ptr<SocketManager>> released;
+  for (auto it = _sockmans.begin(); it != _sockmans.end(); /**/) {
+    if (isReleased(*it)) {
+      released.push_back(it->first);
+      it = _sockmans.erase(it);
+    } else {
+      it++;
+    }
   }
+  return released;
 }
 
-void WlanProvider::checkSendSignalType() {
-  if (!_send_signal_types.empty()) {
-    std::list<SendSignalType> temp_send_signal_types;
-    temp_send_signal_types.assign(_send_signal_types.begin(), _send_signal_types.end());
-    _send_signal_types.clear();
+bool WlanProvider::isReleased(const std::pair<std::shared_ptr<SocketManager>, uint64_t> &sockman) {
+  return sockman.first->getSockGeneration() != sockman.second || sockman.first->getMode() != ConnectionMode::DATA;
+}
 
-    for (auto a : _sockmans) {
+// callable from any thread, the list is only touched on the reactor
+void WlanProvider::pushSendSignalType(SendSignalType sst) { //
+  _sepoll_ref->post([this, sst]() -> void {
+    auto search = std::find(_send_signal_types.begin(), _send_signal_types.end(), sst);
+    if (search == _send_signal_types.end()) {
+      _send_signal_types.push_back(sst);
+    }
+    if (!_check_scheduled) { // signals pushed in the same batch go out together
+      _check_scheduled = true;
+      _sepoll_ref->post([this]() -> void { checkSendSignalType(); });
+    }
+  });
+}
+
+void WlanProvider::checkSendSignalType() {
+  std::list<SendSignalType> temp_send_signal_types;
+  temp_send_signal_types.swap(_send_signal_types);
+  _check_scheduled = false;
+  if (std::find(temp_send_signal_types.begin(), temp_send_signal_types.end(), SendSignalType::SESSIONS) != temp_send_signal_types.end()) {
+    _session_tick++; // the connections rebuild the snapshot lazily, see getSessionSnapshot()
+  }
+  if (!temp_send_signal_types.empty()) {
+    for (auto &sockman : _sockmans) {
+      if (isReleased(sockman)) { // not logged in yet, takeReleasedSockMans() gives it back to the login
+        continue;
+      }
+      auto &a = sockman.first;
       for (auto s : temp_send_signal_types) {
         a->pushSendSignalType(s);
       }
@@ -63,6 +197,101 @@ void WlanProvider::checkSendSignalType() {
   }
 }
 
+// the snapshot of the current tick. the first connection asking in a tick builds it, the others wait for it and
+// share the same instance. callable from any thread
+SessionSnapshotPtr WlanProvider::getSessionSnapshot() {
+  std::lock_guard<std::mutex> g(_snapshot_mutex);
+  uint64_t tick = _session_tick;
+  if (!_snapshot || _snapshot->tick != tick) {
+    _snapshot = buildSessionSnapshot(tick);
+  }
+  return _snapshot;
+}
+
+// one ap_client_data() read, converted to AP/Client records with their hashes
+SessionSnapshotPtr WlanProvider::buildSessionSnapshot(uint64_t tick) {
+  auto snapshot = std::make_shared<SessionSnapshot>();
+  snapshot->tick = tick;
+
+  auto sensor_data = ap_client_data();
+  if (sensor_data.is_null()) {
+    return snapshot;
+  }
+  snapshot->aps.reserve(sensor_data.size());
+  for (auto &a : sensor_data) {
+    SessionAP entry;
+    entry.ap = getAPFromJson(a);
+    entry.hash = entry.ap.getAPDataHash();
+    entry.first_client = snapshot->clients.size();
+
+    auto j_clients = a.value("clients", nlohmann::json());
+    if (!j_clients.is_null()) {
+      for (auto &c : j_clients) {
+        SessionClient client;
+        client.client = getClientFromJson(c, entry.ap.bssid_, entry.ap.channel_);
+        client.hash = client.client.getClientDataHash();
+        snapshot->clients.push_back(client);
+      }
+    }
+    entry.client_count = snapshot->clients.size() - entry.first_client;
+    snapshot->aps.push_back(entry);
+  }
+  return snapshot;
+}
+
+AP WlanProvider::getAPFromJson(const nlohmann::json &j) {
+  AP ap;
+  ap.bssid_ = static_cast<uint64_t>(j.value("band", 0)) << (8 * 6);
+  ap.bssid_ += mac::string_to_mac(j.value("bssid", "00:00:00:00:00:00"));
+  ap.ssid_ = j.value("ssid", "");
+  ap.channel_ = static_cast<uint8_t>(j.value("frame_channel", 0));
+  ap.rssi_ = static_cast<int8_t>(j.value("rssi", -90));
+  ap.cipher_ = static_cast<uint8_t>(j.value("cipher", 0));
+  ap.auth_ = static_cast<uint8_t>(j.value("auth", 0));
+  ap.ssid_broadcast_ = static_cast<bool>(j.value("ssid_broadcast", false));
+  ap.channel_width_ = static_cast<uint8_t>(j.value("channel_width", 0));
+  ap.wps_ = static_cast<bool>(j.value("wps", false));
+  ap.pmf_ = static_cast<bool>(j.value("pmf", false));
+  ap.media_ = 1;
+  ap.net_type_ = 1;
+  memset(ap.signature_, 0x00, 32);
+  ap.mgnt_count_ = 0;
+  ap.ctrl_count_ = 0;
+  ap.data_count_ = 0;
+  ap.wds_peer_ = 0;
+  memset(ap.support_rate_, 0x00, 16);
+  ap.mcs_ = 0;
+  ap.support_mimo_ = 0;
+  ap.highest_rate_ = 0;
+  ap.spatial_stream_ = 0;
+  ap.guard_interval_ = 0;
+  ap.last_dt_ = 0;
+  ap.probe_dt_ = 0;
+  return ap;
+}
+
+Client WlanProvider::getClientFromJson(const nlohmann::json &j, uint64_t bssid, uint8_t channel) {
+  Client client;
+  client.client_mac_ = mac::string_to_mac(j.value("client", "00:00:00:00:00:00"));
+  client.rssi_ = static_cast<int8_t>(j.value("rssi", -90));
+  client.bssid_ = bssid;
+  client.channel_ = channel;
+  memset(client.eap_id_, 0x00, 64);
+  client.data_rate_ = 0;
+  client.noise_ = -90;
+  client.mimo_ = 0;
+  memset(client.signature_, 0x00, 32);
+  memset(client.signature5_, 0x00, 32);
+  client.data_size_ = 0;
+  client.mgnt_count_ = 0;
+  client.ctrl_count_ = 0;
+  client.data_count_ = 0;
+  client.auth_count_ = 0;
+  client.last_dt_ = 0;
+  client.probe_dt_ = 0;
+  return client;
+}
+
 /// sensor_data output example
 /*
 [
@@ -2,11 +2,15 @@
 #define _WLAN_PROVIDER_HPP_
 
 #include "SEpoll.hpp"
+#include "session_snapshot.hpp"
 #include "socketmanager.hpp"
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 class SocketManager;
@@ -16,25 +20,38 @@ public:
 private:
   std::shared_ptr<SEpoll<SocketManager>> _sepoll_ref;
   std::shared_ptr<std::vector<std::shared_ptr<SocketManager>>> _total_sockmans_ref;
-  std::vector<std::shared_ptr<SocketManager>> _sockmans;
+  std::vector<std::pair<std::shared_ptr<SocketManager>, uint64_t>> _sockmans; // with the socket generation it was handed over on
 
-  std::list<SendSignalType> _send_signal_types;
+  std::list<SendSignalType> _send_signal_types; // reactor thread only
+  bool _check_scheduled = false;
+
+  /* session snapshot, shared by every DATA connection */
+  std::atomic<uint64_t> _session_tick{0}; // bumped on the reactor for every SESSIONS round
+  std::mutex _snapshot_mutex;
+  SessionSnapshotPtr _snapshot;
+  /* ~session snapshot */
 
 protected:
 public:
   WlanProvider();
   ~WlanProvider();
 
-  void run();
+  void start();
 
   void setSEpollRef(std::shared_ptr<SEpoll<SocketManager>> sepoll_ref);
   void setTotalSockMansRef(std::shared_ptr<std::vector<std::shared_ptr<SocketManager>>> total_sockmans_ref);
   void setSockMan(std::shared_ptr<SocketManager> sockman);
+  std::vector<std::shared_ptr<SocketManager>> takeReleasedSockMans();
 
   void pushSendSignalType(SendSignalType sst);
+  SessionSnapshotPtr getSessionSnapshot();
 
 private:
   void checkSendSignalType();
+  static bool isReleased(const std::pair<std::shared_ptr<SocketManager>, uint64_t> &sockman);
+  static SessionSnapshotPtr buildSessionSnapshot(uint64_t tick);
+  static AP getAPFromJson(const nlohmann::json &j);
+  static Client getClientFromJson(const nlohmann::json &j, uint64_t bssid, uint8_t channel);
 
 protected:
 };
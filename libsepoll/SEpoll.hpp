@@ -4,14 +4,27 @@
 #include "def_hdr.hpp"
 #include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
 #include <functional>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <pthread.h>
+#include <queue>
+#include <random>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <thread>
 #include <unistd.h>
 #include <unordered_map>
@@ -21,6 +34,108 @@
 // using EventType = std::pair<int, uint32_t>;
 using EventType = uint32_t;
 
+// log2 histogram of the time between epoll readiness and the start of the callback (microseconds)
+class SEpollLatencyHistogram {
+public:
+  static const uint32_t BUCKET_COUNT = 24; // [0,1) [1,2) [2,4) ... [2^22, inf) us
+
+private:
+  std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+  std::atomic<uint64_t> m_count;
+  std::atomic<uint64_t> m_sum_us;
+  std::atomic<uint64_t> m_max_us;
+
+public:
+  SEpollLatencyHistogram() { reset(); }
+
+  void record(std::chrono::steady_clock::duration latency) {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    uint32_t idx = 0;
+    while (idx < BUCKET_COUNT - 1 && (1ull << idx) <= us) {
+      idx++;
+    }
+    m_buckets[idx].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum_us.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = m_max_us.load(std::memory_order_relaxed);
+    while (us > max && !m_max_us.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  void reset() {
+    for (auto &b : m_buckets) {
+      b.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum_us.store(0, std::memory_order_relaxed);
+    m_max_us.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t getCount() { return m_count.load(std::memory_order_relaxed); }
+  uint64_t getBucket(uint32_t idx) { return idx < BUCKET_COUNT ? m_buckets[idx].load(std::memory_order_relaxed) : 0; }
+  uint64_t getMaxUs() { return m_max_us.load(std::memory_order_relaxed); }
+  double getAvgUs() {
+    uint64_t count = getCount();
+    return count ? static_cast<double>(m_sum_us.load(std::memory_order_relaxed)) / count : 0;
+  }
+
+  // smallest bucket upper bound (us) that covers the given percentile (0 ~ 100)
+  uint64_t getPercentileUs(double percentile) {
+    uint64_t count = getCount();
+    uint64_t target = static_cast<uint64_t>(count * percentile / 100);
+    uint64_t acc = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; i++) {
+      acc += getBucket(i);
+      if (acc > target) {
+        return 1ull << i;
+      }
+    }
+    return 1ull << (BUCKET_COUNT - 1);
+  }
+
+  void print(const char *name) {
+    printf("%s latency: count=%lu avg=%.1fus p50<%luus p99<%luus max=%luus\n", name, (unsigned long)getCount(), getAvgUs(),
+           (unsigned long)getPercentileUs(50), (unsigned long)getPercentileUs(99), (unsigned long)getMaxUs());
+    for (uint32_t i = 0; i < BUCKET_COUNT; i++) {
+      uint64_t c = getBucket(i);
+      if (c) {
+        printf("  < %8luus : %lu\n", (unsigned long)(1ull << i), (unsigned long)c);
+      }
+    }
+  }
+};
+
+// listener side counters, shared by all reactors
+class SEpollAcceptStats {
+public:
+private:
+  std::atomic<uint64_t> m_accepted;
+  std::atomic<uint64_t> m_rejected;  // accept() errors other than EAGAIN (EMFILE, ENOBUFS, ...)
+  std::atomic<uint64_t> m_pool_full; // accepted but closed because no FDType was free
+
+public:
+  SEpollAcceptStats() { reset(); }
+
+  void addAccepted() { m_accepted.fetch_add(1, std::memory_order_relaxed); }
+  void addRejected() { m_rejected.fetch_add(1, std::memory_order_relaxed); }
+  void addPoolFull() { m_pool_full.fetch_add(1, std::memory_order_relaxed); }
+
+  void reset() {
+    m_accepted.store(0, std::memory_order_relaxed);
+    m_rejected.store(0, std::memory_order_relaxed);
+    m_pool_full.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t getAccepted() { return m_accepted.load(std::memory_order_relaxed); }
+  uint64_t getRejected() { return m_rejected.load(std::memory_order_relaxed); }
+  uint64_t getPoolFull() { return m_pool_full.load(std::memory_order_relaxed); }
+
+  void print(const char *name) {
+    printf("%s accept: accepted=%lu rejected=%lu pool_full=%lu\n", name, (unsigned long)getAccepted(), (unsigned long)getRejected(),
+           (unsigned long)getPoolFull());
+  }
+};
+
 class SEpollFDFunc {
 public:
 private:
@@ -29,9 +144,17 @@ private:
   std::recursive_mutex m_mutex_what;
   std::recursive_mutex m_mutex_read;
   std::recursive_mutex m_mutex_write;
-  std::thread m_thr;
-  bool m_run_thr = true;
   uint32_t m_what = 0;
+  bool m_scheduled = false; // queued on / running in a dispatcher thread
+  std::chrono::steady_clock::time_point m_ready_time; // when m_what became non-zero
+  std::chrono::steady_clock::time_point m_last_event; // last epoll event, for idle timeouts
+
+  std::mutex m_mutex_epoll;
+  int m_epoll_fd = -1;
+  uint32_t m_epoll_flags = 0; // added to every registration (EPOLLET or EPOLLONESHOT)
+  bool m_registered = false;
+  bool m_armed = false; // EPOLLONESHOT : false from the reported event until dispatch() finished
+  uint32_t m_registered_what = 0; // interest mask currently known by the kernel
 
   std::function<void(int fd, short what, void *arg)> m_read_func = NULL;
   void *m_read_arg = NULL;
@@ -43,22 +166,49 @@ private:
   uint32_t m_write_what = 0;
   bool m_write_oneshot = false;
 
+  std::function<void()> m_release_func = NULL; // runs in the destructor, before the fd is closed
+
 public:
   SEpollFDFunc(int fd) {
     m_fd = fd;
-    m_run_thr = true;
-    m_thr = std::thread(&SEpollFDFunc::run, this);
+    m_last_event = std::chrono::steady_clock::now();
   }
   ~SEpollFDFunc() {
-    m_run_thr = false;
-    if (m_thr.joinable()) {
-      m_thr.join();
+    // runs only when the last dispatcher reference is gone, so no callback of this fd is still running
+    // and the fd number is never reused under one
+    if (m_release_func) {
+      m_release_func();
     }
+    if (m_fd != -1) {
+      close(m_fd);
+    }
+  }
+
+  // set by the owning reactor while it still holds a reference
+  void setReleaseFunc(std::function<void()> func) { //
+    m_release_func = func;
   }
 
-  void orEvent(uint32_t what) {
+  // returns true when the fd is not scheduled yet and the caller has to post it to the dispatcher.
+  // reported : the event came from epoll_wait. a raised one leaves the kernel's arming as it is
+  bool orEvent(uint32_t what, bool reported = true) {
     std::lock_guard<std::recursive_mutex> g(m_mutex_what);
+    m_last_event = std::chrono::steady_clock::now();
+    if (m_what == 0) {
+      m_ready_time = m_last_event;
+    }
     m_what |= what;
+    if (reported && (m_epoll_flags & EPOLLONESHOT)) {
+      // the kernel disarmed the fd when it reported this event, also when it lands in a running dispatch()
+      // that rearm()ed before : the dispatch() in progress has to arm it again
+      std::lock_guard<std::mutex> ge(m_mutex_epoll);
+      m_armed = false;
+    }
+    if (m_scheduled) {
+      return false;
+    }
+    m_scheduled = true;
+    return true;
   }
 
   void setEvent(uint32_t what) {
@@ -71,6 +221,11 @@ public:
     return m_what;
   }
 
+  std::chrono::steady_clock::time_point getLastEventTime() {
+    std::lock_guard<std::recursive_mutex> g(m_mutex_what);
+    return m_last_event;
+  }
+
   void setReadFunc(std::function<void(int fd, short what, void *arg)> read_func, void *arg = NULL, uint32_t what = EPOLLIN) {
     std::lock_guard<std::recursive_mutex> g(m_mutex_read);
     m_read_func = read_func;
@@ -97,14 +252,17 @@ public:
   }
   void executeReadFunc(short what) {
     std::lock_guard<std::recursive_mutex> g(m_mutex_read);
-    if (m_read_func) {
-      m_read_func(m_fd, what, m_read_arg);
-    }
-    if (m_read_oneshot) {
+    auto read_func = m_read_func;
+    void *read_arg = m_read_arg;
+    if (m_read_oneshot) { // cleared before the call so the callback can install the next one
       m_read_func = NULL;
       m_read_arg = NULL;
       m_read_what = 0;
       m_read_oneshot = false;
+      refreshEvent();
+    }
+    if (read_func) {
+      read_func(m_fd, what, read_arg);
     }
   }
 
@@ -133,14 +291,17 @@ public:
   }
   void executeWriteFunc(short what) {
     std::lock_guard<std::recursive_mutex> g(m_mutex_write);
-    if (m_write_func) {
-      m_write_func(m_fd, what, m_write_arg);
-    }
-    if (m_write_oneshot) {
+    auto write_func = m_write_func;
+    void *write_arg = m_write_arg;
+    if (m_write_oneshot) { // cleared before the call so the callback can install the next one
       m_write_func = NULL;
       m_write_arg = NULL;
       m_write_what = 0;
       m_write_oneshot = false;
+      refreshEvent(); // drop EPOLLOUT, otherwise a level-triggered fd keeps waking the reactor
+    }
+    if (write_func) {
+      write_func(m_fd, what, write_arg);
     }
   }
 
@@ -148,42 +309,415 @@ public:
     return m_read_what | m_write_what;
   }
 
+  void setEpoll(int epoll_fd, uint32_t flags) {
+    std::lock_guard<std::mutex> g(m_mutex_epoll);
+    m_epoll_fd = epoll_fd;
+    m_epoll_flags = flags;
+  }
+
+  bool registerEvent() {
+    std::lock_guard<std::mutex> g(m_mutex_epoll);
+    struct epoll_event event;
+    event.events = getWhat() | m_epoll_flags;
+    event.data.fd = m_fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_fd, &event) == -1) {
+      return false;
+    }
+    m_registered = true;
+    m_armed = true;
+    m_registered_what = event.events;
+    return true;
+  }
+
+  // skips epoll_ctl when the interest mask did not change.
+  // force re-arms anyway, which is the only way to get a fresh edge in EPOLLET mode.
+  // an EPOLLONESHOT fd being dispatched is left disarmed, rearm() applies the latest mask when dispatch() ends
+  void refreshEvent(bool force = false) {
+    std::lock_guard<std::mutex> g(m_mutex_epoll);
+    if (!m_registered || ((m_epoll_flags & EPOLLONESHOT) && !m_armed)) {
+      return;
+    }
+    struct epoll_event event;
+    event.events = getWhat() | m_epoll_flags;
+    event.data.fd = m_fd;
+    if (!force && event.events == m_registered_what) {
+      return;
+    }
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, m_fd, &event);
+    m_registered_what = event.events;
+  }
+
+  void unregisterEvent() {
+    std::lock_guard<std::mutex> g(m_mutex_epoll);
+    if (!m_registered) {
+      return;
+    }
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, m_fd, NULL);
+    m_registered = false;
+    m_armed = false;
+    m_registered_what = 0;
+  }
+
+  // called by a dispatcher thread. runs callbacks until no event is left, so callbacks of one fd never overlap
+  void dispatch(SEpollLatencyHistogram *latency = NULL) {
+    while (true) {
+      uint32_t what = 0;
+      std::chrono::steady_clock::time_point ready_time;
+      {
+        std::lock_guard<std::recursive_mutex> g(m_mutex_what);
+        what = m_what;
+        ready_time = m_ready_time;
+        m_what = 0;
+        if (what == 0) {
+          m_scheduled = false;
+          break;
+        }
+      }
+      if (latency) {
+        latency->record(std::chrono::steady_clock::now() - ready_time);
+      }
+      if (isReadWhat(what)) {
+        executeReadFunc(what);
+      }
+      if (isWriteWhat(what)) {
+        executeWriteFunc(what);
+      }
+    }
+    rearm();
+  }
+
 private:
-  void run() {
-    char pname[128] = {0};
-    snprintf(pname, 128, "SEpollFDFunc %d", m_fd);
+  // EPOLLONESHOT : lets the kernel report the fd again, with the mask the callbacks left behind
+  void rearm() {
+    std::lock_guard<std::mutex> g(m_mutex_epoll);
+    if (!m_registered || !(m_epoll_flags & EPOLLONESHOT) || m_armed) {
+      return;
+    }
+    struct epoll_event event;
+    event.events = getWhat() | m_epoll_flags;
+    event.data.fd = m_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, m_fd, &event);
+    m_armed = true;
+    m_registered_what = event.events;
+  }
+};
+
+class SEpollDispatcher {
+public:
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::deque<std::shared_ptr<SEpollFDFunc>> m_queue;
+  std::vector<std::thread> m_thrs;
+  bool m_run_thr = true;
+
+  SEpollLatencyHistogram *m_latency = NULL;
+
+public:
+  SEpollDispatcher(uint32_t thread_count, SEpollLatencyHistogram *latency = NULL) {
+    m_latency = latency;
+    if (thread_count == 0) {
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 0; i < thread_count; i++) {
+      m_thrs.emplace_back(&SEpollDispatcher::run, this, i);
+    }
+  }
+  ~SEpollDispatcher() {
+    {
+      std::lock_guard<std::mutex> g(m_mutex);
+      m_run_thr = false;
+    }
+    m_cond.notify_all();
+    for (auto &thr : m_thrs) {
+      if (thr.joinable()) {
+        thr.join();
+      }
+    }
+  }
+
+  void post(std::shared_ptr<SEpollFDFunc> fdfunc) {
+    {
+      std::lock_guard<std::mutex> g(m_mutex);
+      m_queue.push_back(std::move(fdfunc));
+    }
+    m_cond.notify_one();
+  }
+
+private:
+  void run(uint32_t idx) {
+    char pname[16] = {0};
+    snprintf(pname, 16, "SEpollDisp %u", idx);
     pthread_setname_np(pthread_self(), pname);
-    while (m_run_thr) {
-      uint32_t what = getEvent();
-      if (what != 0) {
-        if (isReadWhat(what)) {
-          executeReadFunc(what);
+    while (true) {
+      std::shared_ptr<SEpollFDFunc> fdfunc;
+      {
+        std::unique_lock<std::mutex> g(m_mutex);
+        m_cond.wait(g, [this] { return !m_run_thr || !m_queue.empty(); });
+        if (!m_run_thr) {
+          return;
         }
-        if (isWriteWhat(what)) {
-          executeWriteFunc(what);
-        }
-        setEvent(0);
+        fdfunc = std::move(m_queue.front());
+        m_queue.pop_front();
       }
+      fdfunc->dispatch(m_latency);
+    }
+  }
+};
+
+// multi-producer / single-consumer queue of closures for one reactor (intrusive Vyukov queue).
+// push() never takes a lock. the eventfd is only written when the reactor has not been woken up yet
+class SEpollTaskQueue {
+public:
+private:
+  struct Node {
+    std::atomic<Node *> next;
+    std::function<void()> func;
+  };
+
+  std::atomic<Node *> m_head; // last pushed node, producers
+  Node *m_tail = NULL;        // already consumed stub, reactor only
+  std::atomic<bool> m_wakeup_pending;
+  int m_event_fd = -1;
 
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+public:
+  SEpollTaskQueue() {
+    Node *stub = new Node();
+    stub->next.store(NULL, std::memory_order_relaxed);
+    m_head.store(stub, std::memory_order_relaxed);
+    m_tail = stub;
+    m_wakeup_pending.store(false, std::memory_order_relaxed);
+    m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event_fd == -1) {
+      printf("eventfd create fail\n");
+    }
+  }
+  ~SEpollTaskQueue() {
+    while (m_tail) {
+      Node *next = m_tail->next.load(std::memory_order_relaxed);
+      delete m_tail;
+      m_tail = next;
+    }
+    if (m_event_fd != -1) {
+      close(m_event_fd);
+    }
+  }
+
+  int getFD() { return m_event_fd; }
+
+  void push(std::function<void()> func) {
+    Node *node = new Node();
+    node->next.store(NULL, std::memory_order_relaxed);
+    node->func = std::move(func);
+    Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+    if (!m_wakeup_pending.exchange(true, std::memory_order_acq_rel)) {
+      uint64_t one = 1;
+      if (write(m_event_fd, &one, sizeof(one)) == -1) {
+        printf("eventfd write fail\n");
+      }
+    }
+  }
+
+  // reactor thread only. runs every queued closure, including ones pushed while running
+  void run() {
+    uint64_t value = 0;
+    ssize_t res = read(m_event_fd, &value, sizeof(value)); // EAGAIN when a previous run() already consumed the wakeup
+    (void)res;
+    // cleared before draining : a push that lands after this line writes the eventfd again
+    m_wakeup_pending.exchange(false, std::memory_order_acq_rel);
+    while (Node *next = m_tail->next.load(std::memory_order_acquire)) {
+      delete m_tail;
+      m_tail = next;
+      auto func = std::move(next->func);
+      next->func = NULL;
+      if (func) {
+        func();
+      }
     }
   }
 };
 
+// timerfd backed min-heap of one-shot / periodic callbacks. the fd is registered on a reactor's epoll
+// and run() is called from that reactor thread when it becomes readable
+class SEpollTimerQueue {
+public:
+private:
+  struct Timer {
+    std::function<void()> func;
+    uint32_t interval_ms = 0; // 0 : one-shot
+  };
+  struct TimerSlot {
+    std::chrono::steady_clock::time_point when;
+    uint64_t id;
+    bool operator>(const TimerSlot &other) const { return when > other.when; }
+  };
+
+  int m_timer_fd = -1;
+  std::mutex m_mutex;
+  std::priority_queue<TimerSlot, std::vector<TimerSlot>, std::greater<TimerSlot>> m_heap; // may hold cancelled ids
+  std::unordered_map<uint64_t, Timer> m_timers;
+  uint64_t m_next_id = 1;
+
+public:
+  SEpollTimerQueue() {
+    m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timer_fd == -1) {
+      printf("timerfd create fail\n");
+    }
+  }
+  ~SEpollTimerQueue() {
+    if (m_timer_fd != -1) {
+      close(m_timer_fd);
+    }
+  }
+
+  int getFD() { return m_timer_fd; }
+
+  // returns an id for cancel(), never 0. callable from any thread
+  uint64_t add(uint32_t delay_ms, std::function<void()> func, uint32_t interval_ms = 0) {
+    std::lock_guard<std::mutex> g(m_mutex);
+    uint64_t id = m_next_id++;
+    Timer timer;
+    timer.func = func;
+    timer.interval_ms = interval_ms;
+    m_timers[id] = timer;
+    m_heap.push(TimerSlot{std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms), id});
+    if (m_heap.top().id == id) {
+      arm();
+    }
+    return id;
+  }
+
+  // also stops a periodic timer from inside its own callback
+  void cancel(uint64_t id) {
+    std::lock_guard<std::mutex> g(m_mutex);
+    m_timers.erase(id);
+  }
+
+  // runs every timer that was due on entry, then re-arms the timerfd for the next one
+  void run() {
+    uint64_t expirations = 0;
+    while (read(m_timer_fd, &expirations, sizeof(expirations)) > 0) {
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> g(m_mutex);
+    while (!m_heap.empty() && m_heap.top().when <= now) {
+      TimerSlot slot = m_heap.top();
+      m_heap.pop();
+      auto find_timer = m_timers.find(slot.id);
+      if (find_timer == m_timers.end()) { // cancelled
+        continue;
+      }
+      auto func = find_timer->second.func;
+      uint32_t interval_ms = find_timer->second.interval_ms;
+      if (interval_ms == 0) {
+        m_timers.erase(find_timer);
+      }
+
+      g.unlock();
+      if (func) {
+        func();
+      }
+      g.lock();
+
+      if (interval_ms != 0 && m_timers.count(slot.id)) {
+        // keeps the period without drift, but never replays missed ticks in a burst
+        slot.when = std::max(slot.when + std::chrono::milliseconds(interval_ms), now);
+        m_heap.push(slot);
+      }
+    }
+    arm();
+  }
+
+private:
+  // caller holds m_mutex
+  void arm() {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (!m_heap.empty()) {
+      auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(m_heap.top().when - std::chrono::steady_clock::now()).count();
+      delay = std::max<int64_t>(delay, 1); // 0 would disarm
+      its.it_value.tv_sec = delay / 1000000000;
+      its.it_value.tv_nsec = delay % 1000000000;
+    }
+    timerfd_settime(m_timer_fd, 0, &its, NULL);
+  }
+};
+
 template <class FDType> class SEpoll {
 public:
 private:
-  // std::recursive_mutext m_fds_mutex;
+  // non-blocking connect waiting for EPOLLOUT, CONNECT only
+  struct PendingConnect {
+    std::shared_ptr<FDType> fdt;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  // one epoll instance, its own listener (ACCEPT) and the thread that waits on it.
+  // a connection stays on the reactor that accepted / connected it, and every change to it runs there
+  struct Reactor {
+    uint32_t idx = 0;
+    int epoll_fd = -1;
+    int sock_fd = -1; // listener, ACCEPT only
+    struct epoll_event *events = NULL;
+    std::unordered_map<int, PendingConnect> pending_connects; // by fd, touched by this reactor only
+    SEpollTaskQueue tasks;                                    // closures posted by other threads
+    std::thread thr;
+  };
+
+  // reconnect schedule of an idle slot after a failed connect
+  struct ConnectBackoff {
+    std::chrono::steady_clock::time_point next_try;
+    uint32_t backoff_ms = 0;
+  };
 
   std::function<void(FDType &, int)> m_fd_set_func;
-  std::function<int(FDType)> m_fd_get_func;
+  std::function<int(FDType &)> m_fd_get_func;
+
+  // written only by the reactor that owns the fd. owner is also read by getFDTypeByFD(), hence atomic_load / atomic_store
+  struct FDEntry {
+    std::atomic<Reactor *> reactor{NULL}; // NULL while the fd is not managed
+    std::shared_ptr<SEpollFDFunc> func;
+    std::shared_ptr<FDType> owner;
+    uint64_t handshake_timer = 0; // pending until the init read func is replaced
+  };
+  static const size_t FD_CHUNK_SIZE = 1024;
 
   std::shared_ptr<std::vector<std::shared_ptr<FDType>>> m_fds;
-  std::unordered_map<int, std::shared_ptr<SEpollFDFunc>> m_fds_funcs;
+  std::mutex m_fd_table_mutex;                             // m_idle_fds, fd chunk allocation, connect backoffs
+  std::unique_ptr<std::atomic<FDEntry *>[]> m_fd_chunks; // fd -> FDEntry, chunks never move so lookups take no lock
+  size_t m_fd_chunk_count = 0;
+  std::vector<std::shared_ptr<FDType>> m_idle_fds; // free-list of FDTypes without a socket
+
+  uint32_t m_dispatch_thread_count = 0; // 0 : number of cores
+  std::unique_ptr<SEpollDispatcher> m_dispatcher;
+  SEpollLatencyHistogram m_dispatch_latency;
+
+  uint32_t m_reactor_count = 1; // 0 : number of cores
+  bool m_pin_reactors = false;
+  std::vector<std::unique_ptr<Reactor>> m_reactors;
+  std::atomic<Reactor *> m_main_reactor{NULL}; // reactor 0 once run() started
+
+  uint32_t m_connect_timeout_ms = 3000;
+  uint32_t m_connect_backoff_min_ms = 500;
+  uint32_t m_connect_backoff_max_ms = 30000;
+  std::unordered_map<FDType *, ConnectBackoff> m_connect_backoffs; // guarded by m_fd_table_mutex
+  std::minstd_rand m_connect_jitter;                               // guarded by m_fd_table_mutex
+
+  SEpollTimerQueue m_timers; // runs on reactor 0
+  uint32_t m_handshake_timeout_ms = 0;
+  uint32_t m_idle_timeout_ms = 0;
+
+  int m_listen_backlog = 5;
+  bool m_batch_accept = false;
+  SEpollAcceptStats m_accept_stats;
 
   SEPOLL_TYPE m_type = SEPOLL_TYPE::ACCEPT;
 
   uint32_t m_epoll_size = 1024;
+  bool m_edge_triggered = false;
   uint16_t m_port = 4000;
   std::string m_ip = "";
 
@@ -193,54 +727,138 @@ private:
   uint32_t m_init_write_what = 0;
   std::function<void(int, short, void *arg)> m_init_write_func = NULL;
 
-  // socket variables
-  int m_sock_fd = -1;
-  struct sockaddr_in m_sock_addr;
-  // ~socket variables
-
-  // epoll variables
-  int m_epoll_fd = -1;
-  struct epoll_event m_event;
-  struct epoll_event *m_events;
-  // ~epoll variables
-
 protected:
 public:
-  SEpoll(std::function<void(FDType &, int)> fd_set_func, std::function<int(FDType)> fd_get_func,
+  SEpoll(std::function<void(FDType &, int)> fd_set_func, std::function<int(FDType &)> fd_get_func,
          std::shared_ptr<std::vector<std::shared_ptr<FDType>>> fds, SEPOLL_TYPE type, std::string ip, uint16_t port) {
     m_fd_set_func = fd_set_func;
     m_fd_get_func = fd_get_func;
     m_fds = fds;
+    for (auto fdt : *m_fds) {
+      if (fdt && m_fd_get_func(*fdt) == -1) {
+        m_idle_fds.push_back(fdt);
+      }
+    }
 
     m_epoll_size = fds->size() + 1;
 
+    rlim_t max_fds = 65536;
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur != RLIM_INFINITY) {
+      max_fds = nofile.rlim_cur;
+    }
+    m_fd_chunk_count = (max_fds + FD_CHUNK_SIZE - 1) / FD_CHUNK_SIZE;
+    m_fd_chunks.reset(new std::atomic<FDEntry *>[m_fd_chunk_count]);
+    for (size_t i = 0; i < m_fd_chunk_count; i++) {
+      m_fd_chunks[i].store(NULL, std::memory_order_relaxed);
+    }
+
     m_type = type;
     m_port = port;
     m_ip = ip;
 
-    SEPOLL_RESULT ret = SEPOLL_RESULT::SUCCESS;
-    if (m_type == SEPOLL_TYPE::ACCEPT) {
-      ret = initAccept();
-    } else { // SEPOLL_TYPE::CONNECT
-      ret = initConnect();
+    m_connect_jitter.seed(std::random_device()());
+  }
+  ~SEpoll() {
+    for (size_t i = 0; i < m_fd_chunk_count; i++) {
+      delete[] m_fd_chunks[i].load(std::memory_order_relaxed);
     }
+  }
 
-    if (ret == SEPOLL_RESULT::FAIL) {
-      printf("SEpoll Init Failed\n");
-    }
+  // must be called before run(). 0 means one dispatcher thread per core
+  void setDispatchThreads(uint32_t count) { //
+    m_dispatch_thread_count = count;
+  }
+
+  // must be called before run(). starts count reactors, each with its own epoll instance and,
+  // in ACCEPT mode, its own SO_REUSEPORT listener so the kernel spreads new connections. 0 means one per core
+  void setReactors(uint32_t count) { //
+    m_reactor_count = count;
+  }
+
+  // must be called before run(). reactor n is pinned to core (n % number of cores)
+  void setPinReactors(bool pin) { //
+    m_pin_reactors = pin;
   }
 
+  // must be called before run(). backlog of the listening socket(s)
+  void setListenBacklog(int backlog) { //
+    m_listen_backlog = backlog;
+  }
+
+  // must be called before run(). the listener becomes non-blocking and every readiness event drains
+  // the accept queue with accept4() until EAGAIN instead of accepting a single connection
+  void setBatchAccept(bool batch_accept) { //
+    m_batch_accept = batch_accept;
+  }
+
+  SEpollAcceptStats &getAcceptStats() { return m_accept_stats; }
+
+  // CONNECT only. a connect that did not complete within timeout_ms is dropped and retried later
+  void setConnectTimeout(uint32_t timeout_ms) { //
+    m_connect_timeout_ms = timeout_ms;
+  }
+
+  // CONNECT only. a slot whose connect failed waits min_ms, doubling up to max_ms, before the next try.
+  // every wait is jittered down to half its length so slots do not retry in lockstep
+  void setConnectBackoff(uint32_t min_ms, uint32_t max_ms) {
+    m_connect_backoff_min_ms = std::max(1u, min_ms);
+    m_connect_backoff_max_ms = std::max(m_connect_backoff_min_ms, max_ms);
+  }
+
+  // runs func on reactor 0 after delay_ms, then every interval_ms unless interval_ms is 0.
+  // callable from any thread, callbacks must not block. returns an id for cancelTimer()
+  uint64_t addTimer(uint32_t delay_ms, std::function<void()> func, uint32_t interval_ms = 0) {
+    return m_timers.add(delay_ms, func, interval_ms);
+  }
+  void cancelTimer(uint64_t id) { //
+    m_timers.cancel(id);
+  }
+
+  // closes a connection whose init read func was not replaced (setReadFunc / unsetReadFunc) within timeout_ms. 0 : off
+  void setHandshakeTimeout(uint32_t timeout_ms) { //
+    m_handshake_timeout_ms = timeout_ms;
+  }
+
+  // must be called before run(). closes a connection that saw no epoll event for timeout_ms. 0 : off
+  void setIdleTimeout(uint32_t timeout_ms) { //
+    m_idle_timeout_ms = timeout_ms;
+  }
+
+  // must be called before run(). sockets become non-blocking and are registered with EPOLLET,
+  // so callbacks have to read / write until EAGAIN
+  void setEdgeTriggered(bool edge_triggered) { //
+    m_edge_triggered = edge_triggered;
+  }
+
+  // epoll readiness -> callback start latency
+  SEpollLatencyHistogram &getDispatchLatency() { return m_dispatch_latency; }
+
   void setInitReadFunc(std::function<void(int, short, void *)> func, uint32_t what = EPOLLIN) {
     m_init_read_func = func;
     m_init_read_what = what;
   }
+  // the fd calls below may come from any thread. they run on the reactor owning fd,
+  // inline when called from there and queued otherwise, so they may take effect after returning
   void setReadFunc(int fd, std::function<void(int, short, void *)> func, void *arg = NULL, uint32_t what = EPOLLIN) {
-    m_fds_funcs[fd]->setReadFunc(func, arg, what);
-    refreshEvent(fd);
+    runOnFD(fd, [this, fd, func, arg, what] {
+      auto fdfunc = getFDFunc(fd, true);
+      if (!fdfunc) {
+        return;
+      }
+      fdfunc->setReadFunc(func, arg, what);
+      fdfunc->refreshEvent();
+    });
   }
   void unsetReadFunc(int fd) {
-    m_fds_funcs[fd]->unsetReadFunc();
-    refreshEvent(fd);
+    runOnFD(fd, [this, fd] {
+      auto fdfunc = getFDFunc(fd, true);
+      if (!fdfunc) {
+        return;
+      }
+      fdfunc->unsetReadFunc();
+      fdfunc->refreshEvent();
+    });
   }
 
   void setInitWriteFunc(std::function<void(int, short, void *)> func, uint32_t what = EPOLLOUT) {
@@ -248,141 +866,224 @@ public:
     m_init_write_what = what;
   }
   void setWriteFunc(int fd, std::function<void(int, short, void *)> func, void *arg = NULL, uint32_t what = EPOLLOUT) {
-    m_fds_funcs[fd]->setWriteFunc(func, arg, what);
-    refreshEvent(fd);
+    runOnFD(fd, [this, fd, func, arg, what] {
+      auto fdfunc = getFDFunc(fd);
+      if (!fdfunc) {
+        return;
+      }
+      fdfunc->setWriteFunc(func, arg, what);
+      fdfunc->refreshEvent(m_edge_triggered); // re-arm so an already writable socket reports a new edge
+    });
   }
   void unsetWriteFunc(int fd) {
-    m_fds_funcs[fd]->unsetWriteFunc();
-    refreshEvent(fd);
+    runOnFD(fd, [this, fd] {
+      auto fdfunc = getFDFunc(fd);
+      if (!fdfunc) {
+        return;
+      }
+      fdfunc->unsetWriteFunc();
+      fdfunc->refreshEvent();
+    });
   }
 
-  void removeEvent(int fd) { //
-    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  void removeEvent(int fd) {
+    runOnFD(fd, [this, fd] {
+      auto fdfunc = getFDFunc(fd);
+      if (fdfunc) {
+        fdfunc->unregisterEvent();
+      }
+    });
   }
 
-  void refreshEvent(int fd) {
-    struct epoll_event event;
-    event.events = m_fds_funcs[fd]->getWhat();
-    event.data.fd = fd;
-    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event);
+  void refreshEvent(int fd, bool force = false) {
+    runOnFD(fd, [this, fd, force] {
+      auto fdfunc = getFDFunc(fd);
+      if (fdfunc) {
+        fdfunc->refreshEvent(force);
+      }
+    });
+  }
+
+  // runs fd's callbacks for what as if epoll had reported it, for input a callback left buffered in user space.
+  // queued behind earlier fd calls from the same thread, so it sees a read func set just before
+  void raiseEvent(int fd, uint32_t what = EPOLLIN) {
+    runOnFD(fd, [this, fd, what] {
+      if (getFDFunc(fd)) {
+        dispatchEvent(fd, what, false);
+      }
+    });
+  }
+
+  // runs func on reactor 0. callable from any thread without taking a lock
+  void post(std::function<void()> func) {
+    Reactor *reactor = m_main_reactor.load(std::memory_order_acquire);
+    if (!reactor) { // not running yet, the timer queue keeps it until reactor 0 starts
+      m_timers.add(0, func);
+      return;
+    }
+    reactor->tasks.push(std::move(func));
+  }
+
+  // owner of a connected fd, NULL when the fd is not managed by this SEpoll
+  std::shared_ptr<FDType> getFDTypeByFD(int fd) {
+    FDEntry *entry = findEntry(fd);
+    if (!entry) {
+      return NULL;
+    }
+    return std::atomic_load(&entry->owner);
   }
 
+  // blocks the calling thread, which becomes reactor 0. the other reactors get their own threads
   void run() {
     pthread_setname_np(pthread_self(), "SEpoll");
-    while (1) {
-      if (m_type == SEPOLL_TYPE::ACCEPT) { // SEPOLL_TYPE::ACCEPT
-        runAccept();
-      } else { // SEPOLL_TYPE::CONNECT
-        runConnect();
-      }
-    } // ~while (1)
+    if (m_reactors.empty() && initReactors() == SEPOLL_RESULT::FAIL) {
+      printf("SEpoll Init Failed\n");
+      return;
+    }
+    if (!m_dispatcher) {
+      m_dispatcher.reset(new SEpollDispatcher(m_dispatch_thread_count, &m_dispatch_latency));
+    }
+    if (m_idle_timeout_ms) {
+      addTimer(
+          0,
+          [this] {
+            for (auto &reactor : m_reactors) {
+              reactor->tasks.push([this] { closeIdleFDs(); });
+            }
+          },
+          std::max(100u, m_idle_timeout_ms / 4));
+    }
+    m_main_reactor.store(m_reactors[0].get(), std::memory_order_release);
+    for (size_t i = 1; i < m_reactors.size(); i++) {
+      m_reactors[i]->thr = std::thread(&SEpoll::runReactor, this, m_reactors[i].get());
+    }
+    runReactor(m_reactors[0].get());
   }
 
 private:
-  SEPOLL_RESULT initAccept() {
-    m_sock_fd = socket(PF_INET, SOCK_STREAM, 0);
-    if (m_sock_fd == -1) {
+  SEPOLL_RESULT initReactors() {
+    uint32_t count = m_reactor_count;
+    if (count == 0) {
+      count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      std::unique_ptr<Reactor> reactor(new Reactor());
+      reactor->idx = i;
+
+      /* epoll create */
+      if ((reactor->epoll_fd = epoll_create1(0)) == -1) {
+        printf("epoll create fail\n");
+        return SEPOLL_RESULT::FAIL;
+      }
+
+      /* alloc events */
+      reactor->events = (struct epoll_event *)malloc(sizeof(struct epoll_event) * m_epoll_size);
+
+      if (m_type == SEPOLL_TYPE::ACCEPT && initAccept(*reactor, count > 1) == SEPOLL_RESULT::FAIL) {
+        return SEPOLL_RESULT::FAIL;
+      }
+
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = reactor->tasks.getFD();
+      epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->tasks.getFD(), &event);
+      if (i == 0) { // timers run on reactor 0
+        event.data.fd = m_timers.getFD();
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, m_timers.getFD(), &event);
+      }
+      m_reactors.push_back(std::move(reactor));
+    }
+    return SEPOLL_RESULT::SUCCESS;
+  }
+
+  SEPOLL_RESULT initAccept(Reactor &reactor, bool reuse_port) {
+    reactor.sock_fd = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC | (m_batch_accept ? SOCK_NONBLOCK : 0), 0);
+    if (reactor.sock_fd == -1) {
       printf("socket create fail\n");
       return SEPOLL_RESULT::FAIL;
     }
 
     int optval = 1;
-    setsockopt(m_sock_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    setsockopt(reactor.sock_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    if (reuse_port) { // every reactor binds the same port, the kernel load balances the SYNs
+      setsockopt(reactor.sock_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+    }
 
-    memset(&m_sock_addr, 0, sizeof(m_sock_addr));
-    m_sock_addr.sin_family = AF_INET;
-    m_sock_addr.sin_port = htons(m_port);
-    m_sock_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    struct sockaddr_in sock_addr;
+    memset(&sock_addr, 0, sizeof(sock_addr));
+    sock_addr.sin_family = AF_INET;
+    sock_addr.sin_port = htons(m_port);
+    sock_addr.sin_addr.s_addr = htonl(INADDR_ANY);
 
-    if (bind(m_sock_fd, (struct sockaddr *)&m_sock_addr, sizeof(m_sock_addr)) == -1) {
+    if (bind(reactor.sock_fd, (struct sockaddr *)&sock_addr, sizeof(sock_addr)) == -1) {
       printf("bind fail\n");
       return SEPOLL_RESULT::FAIL;
     }
 
-    if (listen(m_sock_fd, 5) == -1) {
+    if (listen(reactor.sock_fd, m_listen_backlog) == -1) {
       printf("listen fail\n");
       return SEPOLL_RESULT::FAIL;
     }
 
-    /* epoll create */
-    if ((m_epoll_fd = epoll_create1(0)) == -1) {
-      printf("server epoll create fail\n");
-      return SEPOLL_RESULT::FAIL;
-    }
-
     /* epoll ctl add socket */
-    m_event.events = EPOLLIN;
-    m_event.data.fd = m_sock_fd;
-    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_sock_fd, &m_event);
-
-    /* alloc m_events */
-    m_events = (struct epoll_event *)malloc(sizeof(struct epoll_event) * m_epoll_size);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = reactor.sock_fd;
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.sock_fd, &event);
 
     return SEPOLL_RESULT::SUCCESS;
   }
 
-  SEPOLL_RESULT initConnect() {
-    /* epoll create */
-    if ((m_epoll_fd = epoll_create1(0)) == -1) {
-      printf("epoll create fail\n");
-      return SEPOLL_RESULT::FAIL;
+  void runReactor(Reactor *reactor) {
+    currentReactor() = reactor;
+    if (reactor->idx != 0) {
+      char pname[16] = {0};
+      snprintf(pname, 16, "SEpoll %hu", static_cast<uint16_t>(reactor->idx));
+      pthread_setname_np(pthread_self(), pname);
     }
-
-    /* alloc event */
-    m_events = (struct epoll_event *)malloc(sizeof(struct epoll_event) * m_epoll_size);
-
-    return SEPOLL_RESULT::SUCCESS;
+    if (m_pin_reactors) {
+      uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      CPU_SET(reactor->idx % cores, &cpuset);
+      if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+        printf("reactor %u pin fail\n", reactor->idx);
+      }
+    }
+    while (1) {
+      if (m_type == SEPOLL_TYPE::ACCEPT) { // SEPOLL_TYPE::ACCEPT
+        runAccept(*reactor);
+      } else { // SEPOLL_TYPE::CONNECT
+        runConnect(*reactor);
+      }
+    } // ~while (1)
   }
 
-  void runAccept() {
-    int event_count = epoll_wait(m_epoll_fd, m_events, m_epoll_size, -1);
+  void runAccept(Reactor &reactor) {
+    int event_count = epoll_wait(reactor.epoll_fd, reactor.events, m_epoll_size, -1);
 
     if (event_count == -1) {
       printf("epoll wait fail\n");
     }
 
     for (int i = 0; i < event_count; i++) {
-      int who = m_events[i].data.fd;
-      uint32_t what = m_events[i].events;
-
-      if (who == m_sock_fd) { // m_sock_fd event
+      int who = reactor.events[i].data.fd;
+      uint32_t what = reactor.events[i].events;
+
+      if (who == reactor.tasks.getFD()) {
+        reactor.tasks.run();
+      } else if (who == m_timers.getFD()) {
+        m_timers.run();
+      } else if (who == reactor.sock_fd) { // listener event
         if (what & EPOLLIN) {
-          int connect_socket;
-          struct sockaddr_in connect_addr;
-          socklen_t connect_addr_size;
-
-          connect_addr_size = sizeof(connect_addr);
-          connect_socket = accept(m_sock_fd, (struct sockaddr *)&connect_addr, &connect_addr_size);
-
-          /* set fds */
-          auto find_shrfdt = std::find_if(m_fds->begin(), m_fds->end(),
-                                          [fgf = m_fd_get_func](std::shared_ptr<FDType> fdt) -> bool { return fgf(*fdt) == -1; });
-          if (find_shrfdt == m_fds->end()) {
-            close(connect_socket);
-            continue;
+          if (m_batch_accept) {
+            acceptBatch(reactor);
           } else {
-            // set fd
-            m_fd_set_func(**find_shrfdt, connect_socket);
+            acceptOne(reactor, accept(reactor.sock_fd, NULL, NULL));
           }
-
-          /* set fds_func */
-          if (m_fds_funcs.find(connect_socket) == m_fds_funcs.end()) {
-            m_fds_funcs.insert(std::make_pair(connect_socket, std::make_shared<SEpollFDFunc>(connect_socket)));
-          }
-          struct epoll_event client_event;
-          client_event.events = 0;
-          if (m_init_read_func) {
-            m_fds_funcs[connect_socket]->setReadFunc(m_init_read_func, static_cast<void *>(find_shrfdt->get()), m_init_read_what);
-          }
-          if (m_init_write_func) {
-            m_fds_funcs[connect_socket]->setWriteFunc(m_init_write_func, static_cast<void *>(find_shrfdt->get()), m_init_write_what);
-          }
-          client_event.events = m_fds_funcs[connect_socket]->getWhat();
-          client_event.data.fd = connect_socket;
-          epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, connect_socket, &client_event);
         }
       } else { // connected sock event
-        m_fds_funcs[who]->orEvent(what);
+        dispatchEvent(who, what);
         if ((what & EPOLLRDHUP) || (what & EPOLLHUP) || (what & EPOLLERR)) { // necessary event : disconnection, error
           // printf("!!!EPOLLRDHUP || EPOLLHUP || EPOLLERR!!!\n");
           removeFD(who);
@@ -391,87 +1092,375 @@ private:
     }
   }
 
-  void runConnect() {
-    // try connect
-    for (auto fdt : *m_fds) {
-      if (fdt && m_fd_get_func(*fdt) == -1) {
-        printf("start connect\n");
-        int connect_socket = socket(PF_INET, SOCK_STREAM, 0);
-        if (connect_socket == -1) {
-          printf("socket create fail\n");
-          continue;
-        }
-
-        struct sockaddr_in server_addr;
-        memset(&server_addr, 0, sizeof(server_addr));
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(m_port);
-        server_addr.sin_addr.s_addr = inet_addr(m_ip.c_str());
-
-        if (connect(connect_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
-          printf("server connect fail\n");
-          continue;
-        }
-
-        m_fd_set_func(*fdt, connect_socket);
+  // returns false when the accept queue is empty or accept() failed
+  bool acceptOne(Reactor &reactor, int connect_socket) {
+    if (connect_socket == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        m_accept_stats.addRejected();
+      }
+      return false;
+    }
+    m_accept_stats.addAccepted();
+
+    /* set fds */
+    auto fdt = popIdleFD();
+    if (!fdt) {
+      m_accept_stats.addPoolFull();
+      close(connect_socket);
+      return true;
+    }
 
-        if (m_fds_funcs.find(connect_socket) == m_fds_funcs.end()) {
-          m_fds_funcs.insert(std::make_pair(connect_socket, std::make_shared<SEpollFDFunc>(connect_socket)));
-        }
+    addFD(reactor, connect_socket, fdt, (m_edge_triggered && m_batch_accept));
+    return true;
+  }
 
-        struct epoll_event client_event;
-        client_event.events = 0;
-        if (m_init_read_func) {
-          m_fds_funcs[connect_socket]->setReadFunc(m_init_read_func, static_cast<void *>(fdt.get()), m_init_read_what);
-        }
-        if (m_init_write_func) {
-          m_fds_funcs[connect_socket]->setWriteFunc(m_init_write_func, static_cast<void *>(fdt.get()), m_init_write_what);
-        }
-        client_event.events = m_fds_funcs[connect_socket]->getWhat();
-        client_event.data.fd = connect_socket;
-        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, connect_socket, &client_event);
-        printf("end connect (%d)\n", connect_socket);
-      }
+  void acceptBatch(Reactor &reactor) {
+    // accepted sockets only start non-blocking in edge-triggered mode, level-triggered callbacks may still block on recv
+    int flags = SOCK_CLOEXEC | (m_edge_triggered ? SOCK_NONBLOCK : 0);
+    while (acceptOne(reactor, accept4(reactor.sock_fd, NULL, NULL, flags))) {
     }
-    // ~try connect
+  }
+
+  void runConnect(Reactor &reactor) {
+    startConnects(reactor);
 
-    int event_count = epoll_wait(m_epoll_fd, m_events, m_epoll_size, 5000);
+    int event_count = epoll_wait(reactor.epoll_fd, reactor.events, m_epoll_size, nextConnectTimeout(reactor));
 
     if (event_count == -1) {
       printf("epoll wait fail\n");
     }
     for (int i = 0; i < event_count; i++) {
-      int who = m_events[i].data.fd;
-      uint32_t what = m_events[i].events;
+      int who = reactor.events[i].data.fd;
+      uint32_t what = reactor.events[i].events;
 
-      m_fds_funcs[who]->orEvent(what);
+      if (who == reactor.tasks.getFD()) {
+        reactor.tasks.run();
+        continue;
+      }
+      if (who == m_timers.getFD()) {
+        m_timers.run();
+        continue;
+      }
+      if (reactor.pending_connects.count(who)) { // connect completed or failed
+        finishConnect(reactor, who);
+        continue;
+      }
+      dispatchEvent(who, what);
       if ((what & EPOLLRDHUP) || (what & EPOLLHUP) || (what & EPOLLERR)) { // necessary event : disconnection, error
         // printf("!!!EPOLLRDHUP || EPOLLHUP || EPOLLERR!!!\n");
         removeFD(who);
       }
     }
+
+    // drop connects that ran out of time
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = reactor.pending_connects.begin(); it != reactor.pending_connects.end(); /**/) {
+      if (it->second.deadline <= now) {
+        printf("server connect timeout (%d)\n", it->first);
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, it->first, NULL);
+        close(it->first);
+        scheduleReconnect(it->second.fdt);
+        it = reactor.pending_connects.erase(it);
+      } else {
+        it++;
+      }
+    }
   }
 
-  void removeFD(int fd) {
-    printf("remove FD !!! (%d)\n", fd);
-    close(fd);
-    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
-    auto find_shrfdt = std::find_if(m_fds->begin(), m_fds->end(),
-                                    [fgf = m_fd_get_func, fd](std::shared_ptr<FDType> fdt) -> bool { return fgf(*fdt) == fd; });
-    if (find_shrfdt != m_fds->end()) {
-      m_fd_set_func(**find_shrfdt, -1);
+  // starts a non-blocking connect for every idle slot whose backoff has expired. never blocks
+  void startConnects(Reactor &reactor) {
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(m_port);
+    server_addr.sin_addr.s_addr = inet_addr(m_ip.c_str());
+
+    while (auto fdt = popConnectableFD(std::chrono::steady_clock::now())) {
+      printf("start connect\n");
+      int connect_socket = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (connect_socket == -1) {
+        printf("socket create fail\n");
+        scheduleReconnect(fdt);
+        break;
+      }
+
+      if (connect(connect_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == 0) { // loopback may finish at once
+        completeConnect(reactor, connect_socket, fdt);
+        continue;
+      }
+      if (errno != EINPROGRESS) {
+        printf("server connect fail\n");
+        close(connect_socket);
+        scheduleReconnect(fdt);
+        continue;
+      }
+
+      struct epoll_event event;
+      event.events = EPOLLOUT;
+      event.data.fd = connect_socket;
+      if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, connect_socket, &event) == -1) {
+        close(connect_socket);
+        scheduleReconnect(fdt);
+        continue;
+      }
+      PendingConnect pending;
+      pending.fdt = fdt;
+      pending.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_connect_timeout_ms);
+      reactor.pending_connects[connect_socket] = pending;
     }
-    m_fds_funcs.erase(fd);
   }
 
-  FDType getFDTypeByFD(int fd) {
-    for (auto a : m_fds) {
-      if (m_fd_get_func(*a) == fd) {
-        return *a;
+  void finishConnect(Reactor &reactor, int connect_socket) {
+    auto fdt = reactor.pending_connects[connect_socket].fdt;
+    reactor.pending_connects.erase(connect_socket);
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, connect_socket, NULL);
+
+    int sock_err = 0;
+    socklen_t sock_err_len = sizeof(sock_err);
+    if (getsockopt(connect_socket, SOL_SOCKET, SO_ERROR, &sock_err, &sock_err_len) == -1 || sock_err != 0) {
+      printf("server connect fail (%s)\n", strerror(sock_err));
+      close(connect_socket);
+      scheduleReconnect(fdt);
+      return;
+    }
+    completeConnect(reactor, connect_socket, fdt);
+  }
+
+  void completeConnect(Reactor &reactor, int connect_socket, std::shared_ptr<FDType> fdt) {
+    {
+      std::lock_guard<std::mutex> g(m_fd_table_mutex);
+      m_connect_backoffs.erase(fdt.get());
+    }
+    if (!m_edge_triggered) { // level-triggered callbacks expect a blocking socket
+      fcntl(connect_socket, F_SETFL, fcntl(connect_socket, F_GETFL, 0) & ~O_NONBLOCK);
+    }
+    addFD(reactor, connect_socket, fdt, m_edge_triggered);
+    printf("end connect (%d)\n", connect_socket);
+  }
+
+  // puts the slot back on the free-list with its next try pushed out by the (jittered) backoff
+  void scheduleReconnect(std::shared_ptr<FDType> fdt) {
+    std::lock_guard<std::mutex> g(m_fd_table_mutex);
+    ConnectBackoff &backoff = m_connect_backoffs[fdt.get()];
+    if (backoff.backoff_ms == 0) {
+      backoff.backoff_ms = m_connect_backoff_min_ms;
+    } else {
+      backoff.backoff_ms = std::min(backoff.backoff_ms * 2, m_connect_backoff_max_ms);
+    }
+    uint32_t wait_ms = backoff.backoff_ms / 2 + m_connect_jitter() % (backoff.backoff_ms / 2 + 1);
+    backoff.next_try = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+    m_idle_fds.push_back(fdt);
+  }
+
+  // idle slot that may be connected now, NULL when every idle slot is still backing off
+  std::shared_ptr<FDType> popConnectableFD(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> g(m_fd_table_mutex);
+    for (size_t idle_idx = 0; idle_idx < m_idle_fds.size(); idle_idx++) {
+      auto find_backoff = m_connect_backoffs.find(m_idle_fds[idle_idx].get());
+      if (find_backoff != m_connect_backoffs.end() && find_backoff->second.next_try > now) {
+        continue;
       }
+      auto fdt = m_idle_fds[idle_idx];
+      m_idle_fds[idle_idx] = m_idle_fds.back();
+      m_idle_fds.pop_back();
+      return fdt;
     }
     return NULL;
-  };
+  }
+
+  // epoll_wait timeout (ms) : until the next connect deadline or backoff expiry, at most 5s
+  int nextConnectTimeout(Reactor &reactor) {
+    auto now = std::chrono::steady_clock::now();
+    auto next = now + std::chrono::milliseconds(5000);
+    for (auto &pending : reactor.pending_connects) {
+      next = std::min(next, pending.second.deadline);
+    }
+    {
+      std::lock_guard<std::mutex> g(m_fd_table_mutex);
+      for (auto &fdt : m_idle_fds) {
+        auto find_backoff = m_connect_backoffs.find(fdt.get());
+        next = std::min(next, find_backoff == m_connect_backoffs.end() ? now : find_backoff->second.next_try);
+      }
+    }
+    if (next <= now) {
+      return 0;
+    }
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count()) + 1;
+  }
+
+  std::shared_ptr<FDType> popIdleFD() {
+    std::lock_guard<std::mutex> g(m_fd_table_mutex);
+    if (m_idle_fds.empty()) {
+      return NULL;
+    }
+    auto fdt = m_idle_fds.back();
+    m_idle_fds.pop_back();
+    return fdt;
+  }
+
+  // binds a connected socket to a free FDType and registers it with the init callbacks on the given reactor.
+  // is_nonblocking : sock already has O_NONBLOCK (accept4), skips the fcntl round trip
+  void addFD(Reactor &reactor, int sock, std::shared_ptr<FDType> fdt, bool is_nonblocking = false) {
+    FDEntry *entry = makeEntry(sock);
+    if (!entry) {
+      printf("fd out of range (%d)\n", sock);
+      close(sock);
+      std::lock_guard<std::mutex> g(m_fd_table_mutex);
+      m_idle_fds.push_back(fdt);
+      return;
+    }
+
+    if (m_edge_triggered && !is_nonblocking) {
+      fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    auto fdfunc = std::make_shared<SEpollFDFunc>(sock);
+    if (m_init_read_func) {
+      fdfunc->setReadFunc(m_init_read_func, static_cast<void *>(fdt.get()), m_init_read_what);
+    }
+    if (m_init_write_func) {
+      fdfunc->setWriteFunc(m_init_write_func, static_cast<void *>(fdt.get()), m_init_write_what);
+    }
+    // level-triggered fds are reported once per dispatch, otherwise the reactor spins on a ready fd and
+    // a blocking read func would be called again after its data was consumed
+    fdfunc->setEpoll(reactor.epoll_fd, static_cast<uint32_t>(m_edge_triggered ? EPOLLET : EPOLLONESHOT));
+
+    {
+      // set fd
+      std::lock_guard<std::mutex> g(m_fd_table_mutex);
+      m_fd_set_func(*fdt, sock);
+    }
+
+    /* set fds_func */
+    entry->func = fdfunc;
+    std::atomic_store(&entry->owner, fdt);
+    entry->handshake_timer = 0;
+    if (m_handshake_timeout_ms) {
+      std::weak_ptr<SEpollFDFunc> weak_fdfunc = fdfunc;
+      entry->handshake_timer = m_timers.add(m_handshake_timeout_ms, [this, sock, weak_fdfunc] {
+        runOnFD(sock, [this, sock, weak_fdfunc] {
+          if (auto expired = weak_fdfunc.lock()) {
+            printf("handshake timeout (%d)\n", sock);
+            removeFD(sock, expired.get());
+          }
+        });
+      });
+    }
+    entry->reactor.store(&reactor, std::memory_order_release);
+    fdfunc->registerEvent();
+  }
+
+  static Reactor *&currentReactor() {
+    static thread_local Reactor *reactor = NULL;
+    return reactor;
+  }
+
+  FDEntry *findEntry(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) / FD_CHUNK_SIZE >= m_fd_chunk_count) {
+      return NULL;
+    }
+    FDEntry *chunk = m_fd_chunks[fd / FD_CHUNK_SIZE].load(std::memory_order_acquire);
+    return chunk ? &chunk[fd % FD_CHUNK_SIZE] : NULL;
+  }
+
+  FDEntry *makeEntry(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) / FD_CHUNK_SIZE >= m_fd_chunk_count) {
+      return NULL;
+    }
+    if (FDEntry *entry = findEntry(fd)) {
+      return entry;
+    }
+    std::lock_guard<std::mutex> g(m_fd_table_mutex);
+    std::atomic<FDEntry *> &chunk = m_fd_chunks[fd / FD_CHUNK_SIZE];
+    if (!chunk.load(std::memory_order_relaxed)) {
+      chunk.store(new FDEntry[FD_CHUNK_SIZE], std::memory_order_release);
+    }
+    return &chunk.load(std::memory_order_relaxed)[fd % FD_CHUNK_SIZE];
+  }
+
+  // runs task on the reactor owning fd : inline when already on it, queued otherwise. dropped for an unknown fd
+  void runOnFD(int fd, std::function<void()> task) {
+    FDEntry *entry = findEntry(fd);
+    Reactor *reactor = entry ? entry->reactor.load(std::memory_order_acquire) : NULL;
+    if (!reactor) {
+      return;
+    }
+    if (reactor == currentReactor()) {
+      task();
+    } else {
+      reactor->tasks.push(std::move(task));
+    }
+  }
+
+  // owning reactor only. end_handshake : the caller replaces the init read func, so the handshake timeout no longer applies
+  std::shared_ptr<SEpollFDFunc> getFDFunc(int fd, bool end_handshake = false) {
+    FDEntry *entry = findEntry(fd);
+    if (!entry || entry->reactor.load(std::memory_order_relaxed) != currentReactor()) { // closed or moved before the task ran
+      return NULL;
+    }
+    if (end_handshake && entry->handshake_timer) {
+      m_timers.cancel(entry->handshake_timer);
+      entry->handshake_timer = 0;
+    }
+    return entry->func;
+  }
+
+  void dispatchEvent(int fd, uint32_t what, bool reported = true) {
+    FDEntry *entry = findEntry(fd);
+    if (entry && entry->func && entry->func->orEvent(what, reported)) {
+      m_dispatcher->post(entry->func);
+    }
+  }
+
+  // owning reactor only. expected : only remove while fd still belongs to that SEpollFDFunc
+  // (timers may fire after the fd number was reused)
+  void removeFD(int fd, SEpollFDFunc *expected = NULL) {
+    printf("remove FD !!! (%d)\n", fd);
+    FDEntry *entry = findEntry(fd);
+    if (!entry || !entry->func || entry->reactor.load(std::memory_order_relaxed) != currentReactor()) {
+      return;
+    }
+    if (expected && entry->func.get() != expected) {
+      return;
+    }
+    auto fdfunc = std::move(entry->func);
+    entry->reactor.store(NULL, std::memory_order_release);
+    auto owner = std::atomic_exchange(&entry->owner, std::shared_ptr<FDType>());
+    if (entry->handshake_timer) {
+      m_timers.cancel(entry->handshake_timer);
+      entry->handshake_timer = 0;
+    }
+    if (owner) { // a dispatcher thread may still run the owner's callback, it is recycled once that returned
+      fdfunc->setReleaseFunc([this, owner] { releaseOwner(owner); });
+    }
+    fdfunc->unregisterEvent(); // fd is closed once the dispatcher releases it too
+  }
+
+  // any thread. the owner's callbacks are done, its socket is reset and the slot becomes free for the next connection
+  void releaseOwner(std::shared_ptr<FDType> owner) {
+    std::lock_guard<std::mutex> g(m_fd_table_mutex);
+    m_fd_set_func(*owner, -1);
+    m_idle_fds.push_back(owner);
+  }
+
+  // runs on every reactor, each one closes its own idle fds
+  void closeIdleFDs() {
+    auto deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(m_idle_timeout_ms);
+    std::vector<std::pair<int, SEpollFDFunc *>> idle_fdfuncs;
+    for (size_t chunk_idx = 0; chunk_idx < m_fd_chunk_count; chunk_idx++) {
+      FDEntry *chunk = m_fd_chunks[chunk_idx].load(std::memory_order_acquire);
+      for (size_t i = 0; chunk && i < FD_CHUNK_SIZE; i++) {
+        FDEntry &entry = chunk[i];
+        if (entry.reactor.load(std::memory_order_relaxed) == currentReactor() && entry.func && entry.func->getLastEventTime() < deadline) {
+          idle_fdfuncs.emplace_back(static_cast<int>(chunk_idx * FD_CHUNK_SIZE + i), entry.func.get());
+        }
+      }
+    }
+    for (auto &idle : idle_fdfuncs) {
+      printf("idle timeout (%d)\n", idle.first);
+      removeFD(idle.first, idle.second);
+    }
+  }
 };
 
 #endif /* _SEPOLL_HPP_ */
\ No newline at end of file
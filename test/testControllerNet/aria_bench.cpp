@@ -0,0 +1,54 @@
+#include "aria.hpp"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+/* ARIA throughput, CryptBlocks() on the selected engine vs one Crypt() per block. not part of ctest */
+
+extern Byte IV[16]; // aria.cpp's CBC initial vector
+
+// CBC decryption the way it was done before CryptBlocks()
+static void RefDecryptCBC(const Byte *rk, int Nr, Byte *data, uint32_t len) {
+  Byte prev[16], cur[16];
+  memcpy(prev, IV, 16);
+  for (uint32_t b = 0; b < len; b += 16) {
+    memcpy(cur, data + b, 16);
+    Crypt(cur, Nr, rk, data + b);
+    for (int j = 0; j < 16; j++) {
+      data[b + j] ^= prev[j];
+    }
+    memcpy(prev, cur, 16);
+  }
+}
+
+template <typename F> static void Bench(const char *name, size_t bytes, int n, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++) {
+    f();
+  }
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-22s %8.1f MB/s\n", name, bytes * n / sec / 1e6);
+}
+
+int main() {
+  printf("engine: %s\n", CryptBlocksEngine());
+
+  Byte mk[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+  Byte erk[16 * 17], drk[16 * 17];
+  int Nr = EncKeySetup(mk, erk, 128);
+  DecKeySetup(mk, drk, 128);
+  const size_t len = 8192;
+  static Byte buf[len];
+  const int n = 10000;
+
+  Bench("ecb Crypt", len, n, [&] {
+    for (size_t b = 0; b < len; b += 16) {
+      Crypt(buf + b, Nr, erk, buf + b);
+    }
+  });
+  Bench("ecb CryptBlocks", len, n, [&] { CryptBlocks(buf, Nr, erk, buf, len / 16); });
+  Bench("cbc encrypt", len, n, [&] { EncryptCBCRoundKey(erk, Nr, buf, len - 16, buf); }); // serial, always Crypt()
+  Bench("cbc decrypt Crypt", len, n, [&] { RefDecryptCBC(drk, Nr, buf, len); });
+  Bench("cbc decrypt", len, n, [&] { DecryptCBCRoundKey(drk, Nr, buf, len, buf); });
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include "aria.hpp"
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+extern Byte IV[16]; // aria.cpp's CBC initial vector
+
+// CBC the way it was done before CryptBlocks(), one Crypt() per block
+static void RefEncryptCBC(const Byte *rk, int Nr, Byte *data, uint32_t len) {
+  Byte prev[16];
+  memcpy(prev, IV, 16);
+  for (uint32_t b = 0; b < len; b += 16) {
+    for (int j = 0; j < 16; j++) {
+      data[b + j] ^= prev[j];
+    }
+    Crypt(data + b, Nr, rk, data + b);
+    memcpy(prev, data + b, 16);
+  }
+}
+
+// CryptBlocks() on the selected engine matches Crypt() for every key size, in place included
+static bool VerifyBlocks() {
+  std::mt19937 rng(1);
+  Byte mk[32], rk[16 * 17], in[16 * 40], ref[16 * 40], out[16 * 40];
+  const int key_bits[] = {128, 192, 256};
+  for (int iter = 0; iter < 200; iter++) {
+    for (auto &b : mk) {
+      b = rng();
+    }
+    for (auto &b : in) {
+      b = rng();
+    }
+    int Nr = (iter % 2 ? DecKeySetup : EncKeySetup)(mk, rk, key_bits[iter % 3]);
+    size_t n = 1 + iter % 40;
+    for (size_t b = 0; b < n; b++) {
+      Crypt(in + 16 * b, Nr, rk, ref + 16 * b);
+    }
+    CryptBlocks(in, Nr, rk, out, n);
+    if (memcmp(ref, out, 16 * n)) {
+      printf("%s mismatch, Nr %d n %zu\n", CryptBlocksEngine(), Nr, n);
+      return false;
+    }
+    memcpy(out, in, 16 * n);
+    CryptBlocks(out, Nr, rk, out, n);
+    if (memcmp(ref, out, 16 * n)) {
+      printf("%s in place mismatch, Nr %d n %zu\n", CryptBlocksEngine(), Nr, n);
+      return false;
+    }
+  }
+  return true;
+}
+
+// DecryptCBC() must undo the reference encryption, padding included
+static bool VerifyCBC() {
+  std::mt19937 rng(2);
+  Byte rk[16 * 17];
+  for (uint32_t len = 1; len < 300; len += 7) {
+    Byte key[16], buf[320], enc[320];
+    for (auto &b : key) {
+      b = rng();
+    }
+    for (uint32_t j = 0; j < len; j++) {
+      buf[j] = rng();
+    }
+    memcpy(enc, buf, len);
+    EncryptCBC(key, 128, enc, len, enc);
+    uint32_t enc_len = (len / 16 + 1) * 16;
+    Byte ref_enc[320];
+    memcpy(ref_enc, buf, len);
+    for (uint32_t j = len; j < enc_len; j++) {
+      ref_enc[j] = enc_len - len;
+    }
+    int Nr = EncKeySetup(key, rk, 128);
+    RefEncryptCBC(rk, Nr, ref_enc, enc_len);
+    if (memcmp(enc, ref_enc, enc_len)) {
+      printf("cbc encrypt mismatch, len %u\n", len);
+      return false;
+    }
+    DecryptCBC(key, 128, enc, enc_len, enc);
+    if (memcmp(enc, buf, len)) {
+      printf("cbc decrypt mismatch, len %u\n", len);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  bool ok = true;
+  printf("engine: %s\n", CryptBlocksEngine());
+
+  bool blocks = VerifyBlocks();
+  printf("crypt blocks %s\n", blocks ? "ok" : "FAILED");
+  ok = ok && blocks;
+
+  bool cbc = VerifyCBC();
+  printf("cbc %s\n", cbc ? "ok" : "FAILED");
+  ok = ok && cbc;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+#include "SEpoll.hpp"
+#include "packet.hpp"
+#include "pol_collector.hpp"
+#include "socketmanager.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+/*
+ * the mode frame and the first config frame arrive in one write. loginReadFunc stops after the mode frame, so the
+ * config frame waits in the reassembler and the peer sends nothing more : PolCollector has to decode it when it
+ * takes the connection over, without a new EPOLLIN.
+ * the peer then closes and reconnects on the same SocketManager : the new connection logs in from scratch and is
+ * handed over again.
+ */
+
+static const char *SHARED_KEY = "handoff test key";
+
+static void appendFrame(std::vector<uint8_t> &wire, Messages type, SetConfig body_type, uint16_t seq) {
+  BODYHEADER b;
+  b.type = type;
+  b.product = Product::SERVER;
+  b.length = htons(sizeof(TLV));
+  b.res1 = 0;
+  b.res2 = 0;
+  TLV body;
+  body.type = static_cast<uint8_t>(body_type);
+  body.length = 0;
+
+  Packet p;
+  p.insert(reinterpret_cast<uint8_t *>(&b), sizeof(b));
+  p.insert(reinterpret_cast<uint8_t *>(&body), sizeof(body));
+  p.makeHeader(seq);
+  p.encrypt(std::string(SHARED_KEY));
+  wire.insert(wire.end(), p.data(), p.data() + p.size());
+}
+
+static uint16_t freePort() {
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  bind(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  getsockname(s, reinterpret_cast<sockaddr *>(&addr), &len);
+  close(s);
+  return ntohs(addr.sin_port);
+}
+
+static int connectPeer(uint16_t port) {
+  int peer = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int i = 0; i < 200; i++) {
+    if (connect(peer, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0) {
+      return peer;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  close(peer);
+  return -1;
+}
+
+// the mode frame and a config frame (ignored by configReadFunc) in one write
+static bool sendModeAndConfig(int peer) {
+  std::vector<uint8_t> wire;
+  appendFrame(wire, Messages::C2S_SET_CONFIG, SetConfig::SENSOR_ID, 0);
+  appendFrame(wire, Messages::C2S_SET_CONFIG, SetConfig::FIRMWARE, 1);
+  return send(peer, wire.data(), wire.size(), 0) == static_cast<ssize_t>(wire.size());
+}
+
+template <typename F> static bool waitFor(F done) {
+  for (int i = 0; i < 200; i++) {
+    if (done()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+static int finish(bool ok) {
+  printf("config handoff %s\n", ok ? "ok" : "FAILED");
+  fflush(stdout);
+  _exit(ok ? 0 : 1); // SEpoll::run() does not return
+}
+
+int main() {
+  uint16_t port = freePort();
+  auto sockmans = std::make_shared<std::vector<std::shared_ptr<SocketManager>>>();
+  auto sockman = std::make_shared<SocketManager>(ConnectionType::ACCEPT, SHARED_KEY);
+  sockmans->push_back(sockman);
+  auto pc = std::make_shared<PolCollector>();
+
+  // the login itself is not under test, the connection starts right before the mode frame
+  auto set_func = [](SocketManager &sm, int sock) -> void {
+    sm.setSock(sock);
+    if (sock != -1) {
+      sm.setState(ConnectionState::SET_SENSOR_ID);
+    }
+  };
+  auto get_func = [](SocketManager &sm) -> int { return sm.getSock(); };
+  auto sepoll = std::make_shared<SEpoll<SocketManager>>(set_func, get_func, sockmans, SEPOLL_TYPE::ACCEPT, "127.0.0.1", port);
+  sepoll->setInitReadFunc([](int fd, short what, void *arg) -> void { static_cast<SocketManager *>(arg)->loginReadFunc(fd, what); },
+                          EPOLLIN);
+  sockman->setSEpollRef(sepoll);
+  sockman->setPolCollector(pc);
+  pc->setSEpollRef(sepoll);
+  pc->setTotalSockMansRef(sockmans);
+  std::thread([sepoll] { sepoll->run(); }).detach();
+
+  int peer = connectPeer(port);
+  if (peer == -1) {
+    printf("connect failed\n");
+    return finish(false);
+  }
+  if (!sendModeAndConfig(peer)) {
+    printf("send failed\n");
+    return finish(false);
+  }
+
+  if (!waitFor([&] { return sockman->getMode() == ConnectionMode::CONFIG; })) {
+    printf("mode frame not read\n");
+    return finish(false);
+  }
+  if (sockman->getRecvFrames() != 1) {
+    printf("login read %llu frames, expected only the mode frame\n", static_cast<unsigned long long>(sockman->getRecvFrames()));
+    return finish(false);
+  }
+
+  // the handoff main.cpp's timer does on reactor 0
+  sepoll->post([sepoll, sockman, pc] {
+    sepoll->unsetReadFunc(sockman->getSock());
+    pc->setSockMan(sockman);
+  });
+  if (!waitFor([&] { return sockman->getRecvFrames() == 2; })) {
+    printf("buffered config frame not decoded after the handoff\n");
+    return finish(false);
+  }
+
+  // the peer goes away, SEpoll releases the SocketManager for the next connection
+  close(peer);
+  if (!waitFor([&] { return sockman->getSock() == -1; })) {
+    printf("closed connection not released\n");
+    return finish(false);
+  }
+  // main.cpp's timer takes it back into the login list
+  std::atomic<bool> taken_back{false};
+  sepoll->post([pc, sockman, &taken_back] {
+    auto released = pc->takeReleasedSockMans();
+    taken_back = released.size() == 1 && released[0] == sockman;
+  });
+  if (!waitFor([&] { return taken_back.load(); })) {
+    printf("released connection kept by PolCollector\n");
+    return finish(false);
+  }
+
+  peer = connectPeer(port);
+  if (peer == -1) {
+    printf("reconnect failed\n");
+    return finish(false);
+  }
+  if (!sendModeAndConfig(peer)) {
+    printf("send failed after the reconnect\n");
+    return finish(false);
+  }
+  if (!waitFor([&] { return sockman->getRecvFrames() == 3; }) || sockman->getMode() != ConnectionMode::CONFIG) {
+    printf("mode frame not read after the reconnect\n");
+    return finish(false);
+  }
+  sepoll->post([sepoll, sockman, pc] {
+    sepoll->unsetReadFunc(sockman->getSock());
+    pc->setSockMan(sockman);
+  });
+  if (!waitFor([&] { return sockman->getRecvFrames() == 4; })) {
+    printf("buffered config frame not decoded after the second handoff\n");
+    return finish(false);
+  }
+  return finish(true);
+}
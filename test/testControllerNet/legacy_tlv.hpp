@@ -0,0 +1,153 @@
+#ifndef _LEGACY_TLV_HPP_
+#define _LEGACY_TLV_HPP_
+
+#include "ap.hpp"
+#include "client.hpp"
+#include "packet.hpp"
+#include "protocol.hpp"
+#include <vector>
+
+/*
+ * reference encoders for the TLV tests and benches : the getter based serialisation Packet::makeAPData and
+ * Packet::makeClientData used before the field tables in tlv_schema.hpp. their output is the wire format to keep.
+ */
+
+// the serialisation Packet::makeAPData used before writeAPData()
+inline void legacyAPData(Packet &out, const AP &ap) {
+  Packet p;
+
+  std::vector<uint8_t> band_bssid = ap.getAPDataBSSID();
+  p.makeAPDataTLV(APData::BSSID, band_bssid.size(), band_bssid.data());
+
+  std::vector<uint8_t> ssid = ap.getAPDataSSID();
+  p.makeAPDataTLV(APData::SSID, ssid.size(), ssid.data());
+
+  std::vector<uint8_t> channel = ap.getAPDataChannel();
+  p.makeAPDataTLV(APData::CHANNEL, channel.size(), channel.data());
+
+  std::vector<uint8_t> rssi = ap.getAPDataRSSI();
+  p.makeAPDataTLV(APData::RSSI, rssi.size(), rssi.data());
+
+  std::vector<uint8_t> cipher = ap.getAPDataCipher();
+  p.makeAPDataTLV(APData::CIPHER, cipher.size(), cipher.data());
+
+  std::vector<uint8_t> protocol = ap.getAPDataProtocol();
+  p.makeAPDataTLV(APData::PROTOCOL, protocol.size(), protocol.data());
+
+  std::vector<uint8_t> auth = ap.getAPDataAuth();
+  p.makeAPDataTLV(APData::AUTH, auth.size(), auth.data());
+
+  std::vector<uint8_t> mode = ap.getAPDataMode();
+  p.makeAPDataTLV(APData::MODE, mode.size(), mode.data());
+
+  std::vector<uint8_t> signature = ap.getAPDataSignature();
+  p.makeAPDataTLV(APData::SIGNATURE, signature.size(), signature.data());
+
+  std::vector<uint8_t> ssid_b = ap.getAPDataSSIDBroadcast();
+  p.makeAPDataTLV(APData::SSID_BROADCAST, ssid_b.size(), ssid_b.data());
+
+  std::vector<uint8_t> m_cnt = ap.getAPDataMgntCnt();
+  p.makeAPDataTLV(APData::MNGFRM_CNT, m_cnt.size(), m_cnt.data());
+
+  std::vector<uint8_t> c_cnt = ap.getAPDataCtrlCnt();
+  p.makeAPDataTLV(APData::CTRLFRM_CNT, c_cnt.size(), c_cnt.data());
+
+  std::vector<uint8_t> wds_peer = ap.getAPDataWDSPeer();
+  p.makeAPDataTLV(APData::WDS_AP, wds_peer.size(), wds_peer.data());
+
+  std::vector<uint8_t> data_rate = ap.getAPDataDataRate();
+  p.makeAPDataTLV(APData::DATA_RATE, data_rate.size(), data_rate.data());
+
+  std::vector<uint8_t> mcs = ap.getAPDataMCS();
+  p.makeAPDataTLV(APData::MCS, mcs.size(), mcs.data());
+
+  std::vector<uint8_t> channel_width = ap.getAPDataChannelWidth();
+  p.makeAPDataTLV(APData::CHANNEL_WIDTH, channel_width.size(), channel_width.data());
+
+  std::vector<uint8_t> mimo = ap.getAPDataMimo();
+  p.makeAPDataTLV(APData::MIMO, mimo.size(), mimo.data());
+
+  std::vector<uint8_t> highest_rate = ap.getAPDataHighestRate();
+  p.makeAPDataTLV(APData::HIGHEST_RATE, highest_rate.size(), highest_rate.data());
+
+  std::vector<uint8_t> ss = ap.getAPDataSpatialStream();
+  p.makeAPDataTLV(APData::SPATIAL_STREAM, ss.size(), ss.data());
+
+  std::vector<uint8_t> gi = ap.getAPDataGuardInterval();
+  p.makeAPDataTLV(APData::GUARD_INTERVAL, gi.size(), gi.data());
+
+  std::vector<uint8_t> wps = ap.getAPDataWPS();
+  p.makeAPDataTLV(APData::WPS, wps.size(), wps.data());
+
+  std::vector<uint8_t> pmf = ap.getAPDataPMF();
+  p.makeAPDataTLV(APData::PMF, pmf.size(), pmf.data());
+
+  std::vector<uint8_t> last_dt = ap.getAPDataLastDT();
+  p.makeAPDataTLV(APData::LAST_DT, last_dt.size(), last_dt.data());
+
+  std::vector<uint8_t> probe_dt = ap.getAPDataProbeDT();
+  p.makeAPDataTLV(APData::PROBE_DT, probe_dt.size(), probe_dt.data());
+
+  uint8_t tlv[3] = {static_cast<uint8_t>(DataValue::APS), static_cast<uint8_t>(p.size() >> 8), static_cast<uint8_t>(p.size())};
+  out.insert(tlv, sizeof(tlv));
+  out.insert(p.data(), p.size());
+}
+
+// the serialisation Packet::makeClientData used before writeClientData()
+inline void legacyClientData(Packet &out, const Client &client) {
+  Packet p;
+
+  std::vector<uint8_t> band_bssid = client.getClientDataBSSID();
+  p.makeClientDataTLV(ClientData::BSSID, band_bssid.size(), band_bssid.data());
+
+  std::vector<uint8_t> client_mac = client.getClientDataClientMAC();
+  p.makeClientDataTLV(ClientData::CLIENT_MAC, client_mac.size(), client_mac.data());
+
+  std::vector<uint8_t> eap_id = client.getClientDataEAPID();
+  p.makeClientDataTLV(ClientData::EAP_ID, eap_id.size(), eap_id.data());
+
+  std::vector<uint8_t> data_rate = client.getClientDataDataRate();
+  p.makeClientDataTLV(ClientData::DATA_RATE, data_rate.size(), data_rate.data());
+
+  std::vector<uint8_t> noise = client.getClientDataNoise();
+  p.makeClientDataTLV(ClientData::SN, noise.size(), noise.data());
+
+  std::vector<uint8_t> rssi = client.getClientDataRSSI();
+  p.makeClientDataTLV(ClientData::RSSI, rssi.size(), rssi.data());
+
+  std::vector<uint8_t> mimo = client.getClientDataMimo();
+  p.makeClientDataTLV(ClientData::MIMO, mimo.size(), mimo.data());
+
+  std::vector<uint8_t> sig = client.getClientDataSignature();
+  p.makeClientDataTLV(ClientData::SIGNATURE, sig.size(), sig.data());
+
+  std::vector<uint8_t> sig5 = client.getClientDataSignature5();
+  p.makeClientDataTLV(ClientData::SIGNATURE_5, sig5.size(), sig5.data());
+
+  std::vector<uint8_t> data_size = client.getClientDataDataSize();
+  p.makeClientDataTLV(ClientData::DATA_SIZE, data_size.size(), data_size.data());
+
+  std::vector<uint8_t> m_cnt = client.getClientDataMgntCnt();
+  p.makeClientDataTLV(ClientData::MNGFRM_CNT, m_cnt.size(), m_cnt.data());
+
+  std::vector<uint8_t> c_cnt = client.getClientDataCtrlCnt();
+  p.makeClientDataTLV(ClientData::CTRLFRM_CNT, c_cnt.size(), c_cnt.data());
+
+  std::vector<uint8_t> d_cnt = client.getClientDataDataCnt();
+  p.makeClientDataTLV(ClientData::DATAFRM_CNT, d_cnt.size(), d_cnt.data());
+
+  std::vector<uint8_t> a_cnt = client.getClientDataAuthCnt();
+  p.makeClientDataTLV(ClientData::AUTH_COUNT, a_cnt.size(), a_cnt.data());
+
+  std::vector<uint8_t> last_dt = client.getClientDataLastDT();
+  p.makeClientDataTLV(ClientData::LAST_DT, last_dt.size(), last_dt.data());
+
+  std::vector<uint8_t> probe_dt = client.getClientDataProbeDT();
+  p.makeClientDataTLV(ClientData::PROBE_DT, probe_dt.size(), probe_dt.data());
+
+  uint8_t tlv[3] = {static_cast<uint8_t>(DataValue::CLIENTS), static_cast<uint8_t>(p.size() >> 8), static_cast<uint8_t>(p.size())};
+  out.insert(tlv, sizeof(tlv));
+  out.insert(p.data(), p.size());
+}
+
+#endif /* _LEGACY_TLV_HPP_ */
@@ -0,0 +1,251 @@
+#include "legacy_tlv.hpp"
+#include "packet.hpp"
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+static bool sameBytes(Packet &a, Packet &b) { return a.size() == b.size() && !memcmp(a.data(), b.data(), a.size()); }
+
+// random records: getter bytes == schema bytes, and decode + encode reproduces them
+static bool roundTrip(int n) {
+  std::mt19937 rng(1);
+  auto fill = [&rng](void *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      static_cast<uint8_t *>(p)[i] = rng();
+    }
+  };
+  for (int i = 0; i < n; i++) {
+    AP ap;
+    ap.bssid_ = rng() & 0xffffffffffff;
+    ap.ssid_.assign(rng() % 33, 'a' + i % 26);
+    ap.channel_ = rng() % 200;
+    ap.rssi_ = rng();
+    ap.cipher_ = rng();
+    ap.media_ = rng();
+    ap.auth_ = rng();
+    ap.net_type_ = rng();
+    fill(ap.signature_, sizeof(ap.signature_));
+    ap.ssid_broadcast_ = rng() & 1;
+    ap.mgnt_count_ = rng();
+    ap.ctrl_count_ = rng();
+    ap.wds_peer_ = rng() & 0xffffffffffff;
+    fill(ap.support_rate_, 8);
+    ap.mcs_ = rng();
+    ap.channel_width_ = rng();
+    ap.support_mimo_ = rng();
+    ap.highest_rate_ = rng();
+    ap.spatial_stream_ = rng();
+    ap.guard_interval_ = rng();
+    ap.wps_ = rng() & 1;
+    ap.pmf_ = rng() & 1;
+    ap.last_dt_ = rng();
+    ap.probe_dt_ = rng();
+
+    Packet legacy, schema, again;
+    legacyAPData(legacy, ap);
+    schema.makeAPData(ap);
+    AP decoded;
+    if (!sameBytes(legacy, schema)) {
+      printf("AP %d: schema bytes differ from the getters\n", i);
+      return false;
+    }
+    if (!decoded.readAPData(schema.data() + sizeof(TLV), schema.size() - sizeof(TLV))) {
+      printf("AP %d: decode failed\n", i);
+      return false;
+    }
+    again.makeAPData(decoded);
+    if (!sameBytes(schema, again)) {
+      printf("AP %d: re-encoded bytes differ\n", i);
+      return false;
+    }
+
+    Client client;
+    client.client_mac_ = rng() & 0xffffffffffff;
+    client.bssid_ = ap.bssid_;
+    client.channel_ = ap.channel_;
+    fill(client.eap_id_, 32);
+    client.data_rate_ = rng();
+    client.noise_ = rng();
+    client.rssi_ = rng();
+    client.mimo_ = rng();
+    fill(client.signature_, sizeof(client.signature_));
+    fill(client.signature5_, sizeof(client.signature5_));
+    client.data_size_ = rng();
+    client.mgnt_count_ = rng();
+    client.ctrl_count_ = rng();
+    client.data_count_ = rng();
+    client.auth_count_ = rng();
+    client.last_dt_ = rng();
+    client.probe_dt_ = rng();
+
+    Packet c_legacy, c_schema, c_again;
+    legacyClientData(c_legacy, client);
+    c_schema.makeClientData(client);
+    Client c_decoded;
+    c_decoded.channel_ = client.channel_; // the band byte is derived from the AP's channel, it is not a client field
+    if (!sameBytes(c_legacy, c_schema)) {
+      printf("Client %d: schema bytes differ from the getters\n", i);
+      return false;
+    }
+    if (!c_decoded.readClientData(c_schema.data() + sizeof(TLV), c_schema.size() - sizeof(TLV))) {
+      printf("Client %d: decode failed\n", i);
+      return false;
+    }
+    c_again.makeClientData(c_decoded);
+    if (!sameBytes(c_schema, c_again)) {
+      printf("Client %d: re-encoded bytes differ\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void makeDataPacket(Packet &p, const AP &ap, const Client &client, uint16_t seq) {
+  p.makeAPData(ap);
+  p.makeClientData(client);
+  p.makeDataResponseBody(DataResponse::DATA);
+  p.makeDataResponseBodyHeader();
+  p.makeHeader(seq);
+}
+
+// decrypt(encrypt(p)) gives back p's body, also once the buffers come from the pool
+static bool encryptRoundTrip(int n) {
+  AP ap;
+  ap.bssid_ = 0x0100112233445566;
+  ap.ssid_ = "GNET_BB_CP440_B03DDA";
+  Client client;
+  client.client_mac_ = 0x02fedd24dc9b;
+  client.bssid_ = ap.bssid_;
+  AriaKeyCache key("0123456789abcdef");
+  for (int i = 0; i < n; i++) {
+    Packet plain, p;
+    makeDataPacket(plain, ap, client, static_cast<uint16_t>(i));
+    makeDataPacket(p, ap, client, static_cast<uint16_t>(i));
+    p.encrypt(key);
+    auto d = Packet::decrypt(p.view(), key);
+    // the header now carries the cipher flag and nonce, compare what follows it
+    if (!d || d->size() != plain.size() || memcmp(d->data() + sizeof(HEADER), plain.data() + sizeof(HEADER), d->size() - sizeof(HEADER))) {
+      printf("packet %d: decrypt does not give back the body\n", i);
+      return false;
+    }
+    ap.ssid_ += 'a'; // grow the body across cipher block boundaries
+  }
+  return true;
+}
+
+// the cached round keys match the ones derived from the shared key on every call, both ways
+static bool keyCacheRoundTrip(int n) {
+  const std::string shared_key = "0123456789abcdef";
+  AP ap;
+  ap.bssid_ = 0x0100112233445566;
+  Client client;
+  AriaKeyCache key(shared_key);
+  for (int i = 0; i < n; i++) {
+    Packet by_string, by_cache;
+    makeDataPacket(by_string, ap, client, static_cast<uint16_t>(i));
+    makeDataPacket(by_cache, ap, client, static_cast<uint16_t>(i));
+    by_string.encrypt(shared_key);
+    by_cache.encrypt(key);
+    if (!Packet::decrypt(by_string.view(), key) || !Packet::decrypt(by_cache.view(), shared_key)) {
+      printf("packet %d: cached and uncached keys differ\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// encryptBatch() output decrypts like encrypt()'s, for a burst longer than one lane group
+static bool batchRoundTrip() {
+  AP ap;
+  ap.bssid_ = 0x0100112233445566;
+  ap.ssid_ = "GNET_BB_CP440_B03DDA";
+  Client client;
+  client.client_mac_ = 0x02fedd24dc9b;
+  client.bssid_ = ap.bssid_;
+  AriaKeyCache key("0123456789abcdef");
+  std::vector<Packet> plain, packets;
+  for (int i = 0; i < 37; i++) {
+    for (auto *v : {&plain, &packets}) {
+      Packet p;
+      if (i % 4 == 0) {
+        p.makeAPData(ap);
+      } else {
+        p.makeClientData(client);
+      }
+      p.makeDataResponseBody(DataResponse::DATA);
+      p.makeDataResponseBodyHeader();
+      p.makeHeader(static_cast<uint16_t>(i));
+      v->push_back(std::move(p));
+    }
+    ap.ssid_ += 'a';
+  }
+  Packet::encryptBatch(packets, key);
+  for (size_t i = 0; i < packets.size(); i++) {
+    auto d = Packet::decrypt(packets[i].view(), key);
+    if (!d || d->size() != plain[i].size() || memcmp(d->data() + sizeof(HEADER), plain[i].data() + sizeof(HEADER), d->size() - sizeof(HEADER))) {
+      printf("batch packet %zu: decrypt does not give back the body\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// a packet too large for the 16 bit length field is removed from the batch, its neighbours still go out
+static bool batchDropsOversized() {
+  AP ap;
+  ap.bssid_ = 0x0100112233445566;
+  ap.ssid_ = "GNET_BB_CP440_B03DDA";
+  AriaKeyCache key("0123456789abcdef");
+  std::vector<Packet> packets;
+  for (uint16_t seq = 0; seq < 3; seq++) {
+    Packet p;
+    size_t records = seq == 1 ? UINT16_MAX / ap.getAPDataSize() + 1 : 1;
+    for (size_t r = 0; r < records; r++) {
+      p.makeAPData(ap);
+    }
+    p.makeDataResponseBody(DataResponse::DATA);
+    p.makeDataResponseBodyHeader();
+    p.makeHeader(seq);
+    packets.push_back(std::move(p));
+  }
+  Packet::encryptBatch(packets, key);
+  if (packets.size() != 2) {
+    printf("oversized packet kept, %zu packets left\n", packets.size());
+    return false;
+  }
+  const uint16_t expect_seq[] = {0, 2};
+  for (size_t i = 0; i < packets.size(); i++) {
+    auto d = Packet::decrypt(packets[i].view(), key);
+    if (!d || d->view().getSeq() != expect_seq[i]) {
+      printf("batch packet %zu: expected seq %u\n", i, expect_seq[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  bool ok = true;
+
+  bool round_trip = roundTrip(100000);
+  printf("tlv round trip %s\n", round_trip ? "ok" : "FAILED");
+  ok = ok && round_trip;
+
+  bool encrypt_round_trip = encryptRoundTrip(200);
+  printf("encrypt round trip %s\n", encrypt_round_trip ? "ok" : "FAILED");
+  ok = ok && encrypt_round_trip;
+
+  bool key_cache = keyCacheRoundTrip(200);
+  printf("key cache round trip %s\n", key_cache ? "ok" : "FAILED");
+  ok = ok && key_cache;
+
+  bool batch = batchRoundTrip();
+  printf("batch round trip %s\n", batch ? "ok" : "FAILED");
+  ok = ok && batch;
+
+  bool oversized = batchDropsOversized();
+  printf("batch drops oversized %s\n", oversized ? "ok" : "FAILED");
+  ok = ok && oversized;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include "SEpoll.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+/*
+ * SEpoll::raiseEvent() hammered on an fd while its peer keeps sending. a raised event must never leave the
+ * EPOLLONESHOT fd disarmed : the peer pings one byte at a time and every ping has to be echoed back.
+ * the echo callback raises its own fd as well, so the raised dispatch tends to start while the one before is
+ * rearming and the next ping is reported while it runs.
+ */
+
+struct EchoConn {
+  int fd = -1;
+};
+
+static uint16_t freePort() {
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  bind(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  getsockname(s, reinterpret_cast<sockaddr *>(&addr), &len);
+  close(s);
+  return ntohs(addr.sin_port);
+}
+
+static int finish(bool ok) {
+  printf("raise event %s\n", ok ? "ok" : "FAILED");
+  fflush(stdout);
+  _exit(ok ? 0 : 1); // SEpoll::run() does not return
+}
+
+int main() {
+  const int pings = 20000;
+  uint16_t port = freePort();
+  auto conns = std::make_shared<std::vector<std::shared_ptr<EchoConn>>>();
+  conns->push_back(std::make_shared<EchoConn>());
+  std::atomic<int> accepted_fd{-1};
+
+  auto set_func = [&accepted_fd](EchoConn &c, int fd) -> void {
+    c.fd = fd;
+    if (fd != -1) {
+      accepted_fd = fd;
+    }
+  };
+  auto get_func = [](EchoConn &c) -> int { return c.fd; };
+  auto sepoll = std::make_shared<SEpoll<EchoConn>>(set_func, get_func, conns, SEPOLL_TYPE::ACCEPT, "127.0.0.1", port);
+  sepoll->setDispatchThreads(4);
+  std::weak_ptr<SEpoll<EchoConn>> weak = sepoll;
+  sepoll->setInitReadFunc(
+      [weak](int fd, short what, void *arg) -> void {
+        (void)what;
+        (void)arg;
+        char buf[256];
+        ssize_t n;
+        bool echoed = false;
+        while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) { // raised events find nothing, that is fine
+          send(fd, buf, n, MSG_NOSIGNAL);
+          echoed = true;
+        }
+        if (echoed) {
+          weak.lock()->raiseEvent(fd, EPOLLIN);
+        }
+      },
+      EPOLLIN);
+  std::thread([sepoll] { sepoll->run(); }).detach();
+
+  int peer = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bool connected = false;
+  for (int i = 0; i < 200 && !connected; i++) {
+    connected = connect(peer, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+    if (!connected) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  for (int i = 0; i < 200 && accepted_fd == -1; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (!connected || accepted_fd == -1) {
+    printf("connect failed\n");
+    return finish(false);
+  }
+  timeval tv = {2, 0};
+  setsockopt(peer, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  std::atomic<bool> stop{false};
+  std::thread raiser([&] {
+    int fd = accepted_fd;
+    while (!stop) {
+      sepoll->raiseEvent(fd, EPOLLIN);
+    }
+  });
+
+  int echoed = 0;
+  for (int i = 0; i < pings; i++) {
+    char c = static_cast<char>(i), d = 0;
+    if (send(peer, &c, 1, 0) != 1 || recv(peer, &d, 1, 0) != 1 || d != c) {
+      break;
+    }
+    echoed++;
+  }
+  stop = true;
+  raiser.join();
+  if (echoed != pings) {
+    printf("echo stalled after %d of %d pings\n", echoed, pings);
+    return finish(false);
+  }
+  return finish(true);
+}
@@ -0,0 +1,47 @@
+#include "sha256.hpp"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+/* SHA-256 throughput over typical frame sizes, per engine the CPU has. not part of ctest */
+
+template <typename F> static double MBps(size_t bytes, F f) {
+  int n = 0;
+  auto start = std::chrono::steady_clock::now();
+  double sec = 0;
+  do {
+    f();
+    n++;
+    sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (sec < 0.2);
+  return bytes * n / sec / 1e6;
+}
+
+int main() {
+  printf("engine: %s\n", SHA256::engine());
+
+  const size_t sizes[] = {200, 512, 1500, 4096, 8192};
+  static uint8_t buf[8][8192];
+  uint8_t out[8][32];
+  printf("%6s %10s %10s %14s\n", "bytes", "scalar", "sha-ni", "avx2 8-buffer");
+  for (size_t len : sizes) {
+    const uint8_t *ptrs[8];
+    size_t lens[8];
+    for (int i = 0; i < 8; i++) {
+      ptrs[i] = buf[i];
+      lens[i] = len;
+    }
+    const char *scalar_engine = SHA256::useEngines(false, false);
+    double scalar = MBps(len, [&] { SHA256::digest(buf[0], len, out[0]); });
+    double hw = 0, mb = 0;
+    if (strcmp(SHA256::useEngines(true, false), scalar_engine)) {
+      hw = MBps(len, [&] { SHA256::digest(buf[0], len, out[0]); });
+    }
+    if (strcmp(SHA256::useEngines(false, true), scalar_engine)) {
+      mb = MBps(8 * len, [&] { SHA256::digestMany(ptrs, lens, 8, out); });
+    }
+    printf("%6zu %10.1f %10.1f %14.1f MB/s\n", len, scalar, hw, mb);
+  }
+  SHA256::useEngines(true, true);
+  return 0;
+}